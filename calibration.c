@@ -0,0 +1,74 @@
+#include "calibration.h"
+
+// Defaults, used until a calibration is loaded or performed
+struct calibration calibration = {
+    .noise_pwr = 0,
+    .gate_threshold = 0,
+    .interference_threshold = INTERFERENCE_THRESHOLD,
+    .dc_bias = 128,
+};
+
+static uint32_t dc_bias_sum;
+static uint32_t noise_pwr_sum;
+static uint8_t frame_count;
+
+static void apply_calibration()
+{
+    interference_threshold = calibration.interference_threshold;
+}
+
+void calibration_begin()
+{
+    dc_bias_sum = 0;
+    noise_pwr_sum = 0;
+    frame_count = 0;
+}
+
+void calibration_add_frame(uint8_t array[], uint16_t num_samples)
+{
+    uint8_t dc_bias = calculate_dc_bias(array, num_samples);
+    dc_bias_sum += dc_bias;
+    noise_pwr_sum += calculate_signal_pwr(array, num_samples, dc_bias) * NUM_SAMPLES / num_samples;
+    frame_count++;
+}
+
+bool calibration_finish()
+{
+    if (frame_count == 0)
+        return false;
+
+    uint32_t noise_pwr = noise_pwr_sum / frame_count;
+    if (noise_pwr > CALIBRATION_MAX_NOISE * NUM_SAMPLES)
+        return false;
+
+    calibration.dc_bias = dc_bias_sum / frame_count;
+    calibration.noise_pwr = noise_pwr;
+    calibration.gate_threshold = noise_pwr * NOISE_GATE_RATIO;
+    calibration.interference_threshold = INTERFERENCE_THRESHOLD;
+    if (noise_pwr * INTERFERENCE_NOISE_RATIO > INTERFERENCE_THRESHOLD)
+        calibration.interference_threshold = noise_pwr * INTERFERENCE_NOISE_RATIO;
+
+    apply_calibration();
+    return true;
+}
+
+uint32_t calibration_gate_threshold(uint16_t num_samples)
+{
+    return (uint32_t)calibration.gate_threshold * num_samples / NUM_SAMPLES;
+}
+
+bool load_calibration()
+{
+    struct calibration stored;
+    if (!flash_storage_load(CALIBRATION_STORAGE_SECTOR, CALIBRATION_VERSION, &stored, sizeof(stored)))
+        return false;
+
+    calibration = stored;
+    apply_calibration();
+    return true;
+}
+
+void store_calibration()
+{
+    flash_storage_store(CALIBRATION_STORAGE_SECTOR, CALIBRATION_VERSION, &calibration, sizeof(calibration));
+}
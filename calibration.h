@@ -0,0 +1,79 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "macros.h"
+#include "freq_analysis.h"
+#include "flash_storage.h"
+
+#define CALIBRATION_STORAGE_SECTOR 0
+#define CALIBRATION_VERSION 1
+
+/**
+ * @brief Unit specific parameters, measured with no input signal.
+ *
+ * Powers are expressed in the units of calculate_interference_pwr (sum of absolute values over a frame).
+ */
+struct calibration
+{
+    uint32_t noise_pwr;              // Power of the signal deviation from DC bias with no input
+    uint32_t gate_threshold;         // Frames of power below this threshold are not analyzed
+    int32_t interference_threshold;  // Interference calculation is aborted above this threshold
+    uint8_t dc_bias;                 // Mean sample value with no input
+};
+
+extern struct calibration calibration;
+
+/**
+ * @brief Resets the calibration accumulators, before a new calibration is performed.
+ */
+void calibration_begin();
+
+/**
+ * @brief Accumulates the DC bias and noise power of a single frame captured with no input.
+ *
+ * The noise power is normalized to NUM_SAMPLES, as the frame may be shorter.
+ *
+ * @param array The smoothed samples of the frame.
+ * @param num_samples The number of samples of the frame.
+ */
+void calibration_add_frame(uint8_t array[], uint16_t num_samples);
+
+/**
+ * @brief Calculates the calibration from the accumulated frames, and derives the thresholds.
+ *
+ * The interference threshold is raised to INTERFERENCE_NOISE_RATIO times the noise power, since even perfectly
+ * aligned shifts leave about sqrt(2) times the noise power. The noise gate is set to NOISE_GATE_RATIO times the noise power.
+ * If the noise exceeds CALIBRATION_MAX_NOISE per sample, most likely the input was not quiet, so the result is rejected.
+ *
+ * @return true if the calibration is valid and has been applied.
+ */
+bool calibration_finish();
+
+/**
+ * @brief Scales the noise gate, calibrated over NUM_SAMPLES, to the given window length.
+ *
+ * The threshold is multiplied before it is divided, so gates lower than NUM_SAMPLES are not truncated to 0.
+ *
+ * @param num_samples The number of samples of the gated window.
+ *
+ * @return The power below which a window of num_samples is not analyzed.
+ */
+uint32_t calibration_gate_threshold(uint16_t num_samples);
+
+/**
+ * @brief Loads the calibration stored in flash and applies it.
+ *
+ * @return true if a valid calibration has been found.
+ */
+bool load_calibration();
+
+/**
+ * @brief Stores the applied calibration in flash.
+ *
+ * Must not be called when the other core may be executing from flash.
+ */
+void store_calibration();
+
+#endif
@@ -0,0 +1,60 @@
+#include "flash_storage.h"
+
+// Buffer holding the header and the record, programmed to flash page by page
+static uint8_t page_buffer[4 * FLASH_PAGE_SIZE];
+
+static uint32_t sector_offset(uint8_t sector)
+{
+    return PICO_FLASH_SIZE_BYTES - (sector + 1) * FLASH_SECTOR_SIZE;
+}
+
+uint32_t calculate_checksum(const void *data, uint16_t size)
+{
+    const uint8_t *bytes = data;
+    uint32_t hash = 2166136261u;
+    for (uint16_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool flash_storage_load(uint8_t sector, uint16_t version, void *data, uint16_t size)
+{
+    const uint8_t *stored = (const uint8_t *)(XIP_BASE + sector_offset(sector));
+    const struct flash_storage_header *header = (const struct flash_storage_header *)stored;
+
+    if (header->magic != FLASH_STORAGE_MAGIC || header->size != size || header->version != version)
+        return false;
+    if (header->checksum != calculate_checksum(stored + sizeof(struct flash_storage_header), size))
+        return false;
+
+    memcpy(data, stored + sizeof(struct flash_storage_header), size);
+    return true;
+}
+
+void flash_storage_store(uint8_t sector, uint16_t version, const void *data, uint16_t size)
+{
+    if (size > FLASH_STORAGE_MAX_SIZE)
+        return;
+
+    struct flash_storage_header header = {
+        .magic = FLASH_STORAGE_MAGIC,
+        .size = size,
+        .version = version,
+        .checksum = calculate_checksum(data, size),
+    };
+
+    memset(page_buffer, 0xFF, sizeof(page_buffer));
+    memcpy(page_buffer, &header, sizeof(header));
+    memcpy(page_buffer + sizeof(header), data, size);
+
+    // Only the pages actually used are programmed
+    uint32_t program_size = (sizeof(header) + size + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE;
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(sector_offset(sector), FLASH_SECTOR_SIZE);
+    flash_range_program(sector_offset(sector), page_buffer, program_size);
+    restore_interrupts(interrupts);
+}
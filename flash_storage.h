@@ -0,0 +1,65 @@
+#ifndef FLASH_STORAGE_H
+#define FLASH_STORAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "macros.h"
+
+// Records are stored in the last sectors of the flash, far from the program image.
+// Sector 0 is the last sector of the flash, sector 1 the one before it, and so on.
+#define FLASH_STORAGE_MAGIC 0x54554E52 // "TUNR"
+#define FLASH_STORAGE_MAX_SIZE (4 * FLASH_PAGE_SIZE - sizeof(struct flash_storage_header))
+
+/**
+ * @brief Header preceding each stored record.
+ */
+struct flash_storage_header
+{
+    uint32_t magic;
+    uint16_t size;     // Size of the record following the header
+    uint16_t version;  // Layout version of the record, bumped when the record structure changes
+    uint32_t checksum; // FNV-1a hash of the record
+};
+
+/**
+ * @brief Calculates the FNV-1a hash of the provided data.
+ *
+ * @param data Pointer to the data.
+ * @param size Size of the data in bytes.
+ *
+ * @return The calculated hash.
+ */
+uint32_t calculate_checksum(const void *data, uint16_t size);
+
+/**
+ * @brief Loads a record from the given storage sector.
+ *
+ * The record is only copied if the sector contains a record of the expected size and version, with a valid checksum.
+ *
+ * @param sector Index of the storage sector, counting from the end of the flash.
+ * @param version Expected layout version of the record.
+ * @param data Pointer to the record to fill.
+ * @param size Size of the record in bytes.
+ *
+ * @return true if a valid record was loaded.
+ */
+bool flash_storage_load(uint8_t sector, uint16_t version, void *data, uint16_t size);
+
+/**
+ * @brief Stores a record in the given storage sector, replacing its previous content.
+ *
+ * Interrupts are disabled while the flash is erased and programmed.
+ * Note that the other core must not execute from flash in the meantime,
+ * so either it is not running yet, or it has to be locked out by the caller.
+ *
+ * @param sector Index of the storage sector, counting from the end of the flash.
+ * @param version Layout version of the record.
+ * @param data Pointer to the record to store.
+ * @param size Size of the record in bytes, at most FLASH_STORAGE_MAX_SIZE.
+ */
+void flash_storage_store(uint8_t sector, uint16_t version, const void *data, uint16_t size);
+
+#endif
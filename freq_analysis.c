@@ -1,6 +1,55 @@
+#include <math.h>
 #include "freq_analysis.h"
+#include "hardware/sync.h"
+#include "stats.h"
 
-uint16_t min_in_range(int32_t array[], uint16_t begin_index, uint16_t range)
+int32_t interference_threshold = INTERFERENCE_THRESHOLD;
+uint16_t prior_lags[LAG_PRIOR_CANDIDATES];
+uint8_t prior_lag_count = 0;
+void (*analysis_yield)(void) = NULL;
+uint64_t accumulated_samples[NUM_CORES];
+// Odd while the accumulated samples of the core are being updated, see read_accumulated_samples
+static volatile uint32_t accumulated_sequence[NUM_CORES];
+struct subsample_stats subsample_stats[NUM_CORES];
+struct interference_stats interference_stats[NUM_CORES];
+
+// Interference of the analysis in progress on each core, see freq_analysis_begin
+static uint16_t interference_scratch[NUM_CORES][SHIFT_LIMIT];
+
+// Decimated signal and period votes of calculate_freq_wavelet on each core
+static int16_t wavelet_signal[NUM_CORES][NUM_SAMPLES];
+static uint8_t wavelet_votes[NUM_CORES][NUM_SAMPLES];
+
+static float find_wavelet_period(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *period_votes,
+                                 uint8_t *peak_count);
+
+// Adds to the samples accumulated by the given (calling) core
+static void accumulate_samples(uint core, uint32_t count)
+{
+    accumulated_sequence[core]++;
+    __dmb();
+    accumulated_samples[core] += count;
+    __dmb();
+    accumulated_sequence[core]++;
+}
+
+uint64_t read_accumulated_samples(uint core)
+{
+    while (1)
+    {
+        uint32_t sequence = accumulated_sequence[core];
+        if (sequence & 1)
+            continue;
+        __dmb();
+        uint64_t samples = accumulated_samples[core];
+        __dmb();
+        // Retry if the writer has started over while reading
+        if (accumulated_sequence[core] == sequence)
+            return samples;
+    }
+}
+
+uint16_t min_in_range(uint16_t array[], uint16_t begin_index, uint16_t range)
 {
     uint16_t min_index = begin_index;
     for (uint16_t i = 0; i < range; i++)
@@ -11,13 +60,13 @@ uint16_t min_in_range(int32_t array[], uint16_t begin_index, uint16_t range)
     return min_index;
 }
 
-void calculate_peaks(uint16_t peaks[], uint8_t *peak_count, int32_t array[])
+void calculate_peaks(uint16_t peaks[], uint8_t *peak_count, uint16_t array[], uint16_t shift_limit)
 {
     uint16_t prev_min_index = min_in_range(array, 0, PEAK_SEARCH_RANGE);
     uint16_t current_min_index = min_in_range(array, PEAK_SEARCH_RANGE, PEAK_SEARCH_RANGE);
     uint16_t next_min_index;
 
-    for (uint16_t i = PEAK_SEARCH_RANGE; i < SHIFT_LIMIT - PEAK_SEARCH_RANGE - PEAK_SEARCH_RANGE; i += PEAK_SEARCH_RANGE)
+    for (uint16_t i = PEAK_SEARCH_RANGE; i < shift_limit - PEAK_SEARCH_RANGE - PEAK_SEARCH_RANGE; i += PEAK_SEARCH_RANGE)
     {
         next_min_index = min_in_range(array, i + PEAK_SEARCH_RANGE, PEAK_SEARCH_RANGE);
 
@@ -29,7 +78,12 @@ void calculate_peaks(uint16_t peaks[], uint8_t *peak_count, int32_t array[])
                 break;
 
             (*peak_count)++;
-            printf("FOUND LOCAL MINIMUM! index: %d, val: %d, peak_count: %d\n", current_min_index, array[current_min_index], *peak_count);
+            // Skipped while the metrics response is printed, the shadow engine may run this on core 1
+            if (console_try_lock())
+            {
+                printf("FOUND LOCAL MINIMUM! index: %d, val: %d, peak_count: %d\n", current_min_index, array[current_min_index], *peak_count);
+                console_unlock();
+            }
 
             // Add peak index to array
             peaks[(*peak_count) - 1] = current_min_index;
@@ -64,32 +118,714 @@ uint16_t calculate_sma(uint16_t index, uint8_t array[])
     return sum / (SMA_WIDTH + 1);
 }
 
-int32_t calculate_interference_pwr(int shift, uint8_t array[])
+void update_preconditioning(struct preconditioning *pre, uint8_t dc_bias)
+{
+    pre->dc_bias = dc_bias;
+    pre->clip_level = pre->peak_amplitude * CLIP_RATIO / 100;
+    pre->peak_amplitude = 0;
+    pre->signal_pwr = 0;
+}
+
+void smooth_samples(uint8_t dst[], uint8_t src[], uint16_t num_samples, struct preconditioning *pre)
 {
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i <= SMA_WIDTH; i++)
+    {
+        sum += src[i];
+    }
+
+    // The sample leaving the sum may have been overwritten by the previous output
+    uint8_t leaving = src[0];
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        if (i > 0)
+        {
+            sum += src[i + SMA_WIDTH] - leaving;
+            leaving = src[i];
+        }
+        dst[i] = (sum * SMA_RECIPROCAL) >> SMA_RECIPROCAL_SHIFT;
+#if PRECONDITIONING != PRECONDITIONING_NONE
+        if (pre)
+            dst[i] = precondition_sample(dst[i], pre);
+#endif
+    }
+#if PRECONDITIONING == PRECONDITIONING_NONE
+    (void)pre;
+#endif
+}
+
+void resample_samples(uint8_t dst[], uint8_t src[], uint16_t num_samples, struct preconditioning *pre)
+{
+    // Running sums of the SMA windows starting at ADC sample index and index + 1
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i <= SMA_WIDTH; i++)
+    {
+        sum += src[i];
+    }
+    uint32_t next_sum = sum + src[SMA_WIDTH + 1] - src[0];
+
+    uint16_t index = 0;
+    uint32_t position = 0;
+    for (uint16_t i = 0; i < num_samples; i++, position += RESAMPLE_STEP)
+    {
+        while (index < position >> RESAMPLE_FRACTION_BITS)
+        {
+            index++;
+            sum = next_sum;
+            next_sum += src[index + SMA_WIDTH + 1] - src[index];
+        }
+
+        uint32_t phase = (position >> (RESAMPLE_FRACTION_BITS - RESAMPLE_PHASE_BITS)) & ((1u << RESAMPLE_PHASE_BITS) - 1);
+        uint32_t blended_sum = (sum * ((1u << RESAMPLE_PHASE_BITS) - phase) + next_sum * phase) >> RESAMPLE_PHASE_BITS;
+        dst[i] = (blended_sum * SMA_RECIPROCAL) >> SMA_RECIPROCAL_SHIFT;
+#if PRECONDITIONING != PRECONDITIONING_NONE
+        if (pre)
+            dst[i] = precondition_sample(dst[i], pre);
+#endif
+    }
+#if PRECONDITIONING == PRECONDITIONING_NONE
+    (void)pre;
+#endif
+}
+
+uint8_t calculate_dc_bias(uint8_t array[], uint16_t num_samples)
+{
+    uint32_t sum = 0;
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        sum += array[i];
+    }
+    return sum / num_samples;
+}
+
+uint32_t calculate_signal_pwr(uint8_t array[], uint16_t num_samples, uint8_t dc_bias)
+{
+    uint32_t power = 0;
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        power += abs(array[i] - dc_bias);
+    }
+    return power;
+}
+
+int32_t calculate_interference_pwr(int shift, uint8_t array[], uint16_t num_samples, int32_t threshold)
+{
+    uint core = get_core_num();
+    interference_stats[core].calculations++;
+
     int32_t power_diff = 0;
-    for (uint16_t i = 0; i < NUM_SAMPLES - shift; i++)
+    for (uint16_t i = 0; i < num_samples - shift; i++)
     {
         power_diff += abs(array[i] - array[i + shift]);
         // The line below is inserted to save some calculation. If there is a need to plot and observe interference function, it can be commented out.
-        if (power_diff > INTERFERENCE_THRESHOLD)
+        if (power_diff > threshold)
+        {
+            accumulate_samples(core, i + 1);
+            interference_stats[core].aborts++;
             return INT_MAX;
+        }
     }
+    accumulate_samples(core, num_samples - shift);
     return power_diff;
 }
 
-float calculate_freq(uint8_t array[])
+int32_t estimate_interference_pwr(int shift, uint8_t array[], uint16_t num_samples, int32_t threshold, float *bound)
+{
+    uint16_t length = num_samples - shift;
+    uint16_t strata = length / SUBSAMPLE_STRIDE;
+    uint32_t sum = 0, sum_squares = 0;
+    for (uint16_t stratum = 0; stratum < strata; stratum++)
+    {
+        // Multiplicative hash of the stratum number, the positions are the same for every shift and frame
+        uint16_t i = stratum * SUBSAMPLE_STRIDE + (stratum * 2654435761u >> 24) % SUBSAMPLE_STRIDE;
+        uint32_t diff = abs(array[i] - array[i + shift]);
+        sum += diff;
+        sum_squares += diff * diff;
+        if ((uint64_t)sum * SUBSAMPLE_STRIDE > (uint64_t)threshold * SUBSAMPLE_ABORT_RATIO)
+        {
+            accumulate_samples(get_core_num(), stratum + 1);
+            return INT_MAX;
+        }
+    }
+    accumulate_samples(get_core_num(), strata);
+
+    float mean = (float)sum / strata;
+    float variance = (float)sum_squares / strata - mean * mean;
+    *bound = SUBSAMPLE_CONFIDENCE * length * sqrtf(variance > 0 ? variance / strata : 0);
+    return mean * length + 0.5f;
+}
+
+// Calculates the interference power exactly only if the confidence interval of its estimate reaches the threshold
+static int32_t screen_interference_pwr(int shift, uint8_t array[], uint16_t num_samples, int32_t threshold)
 {
-    int32_t interference[NUM_SAMPLES];
-    for (uint16_t shift = 0; shift < NUM_SAMPLES; shift++)
+    struct subsample_stats *counters = &subsample_stats[get_core_num()];
+    // Too few strata for a meaningful variance
+    if ((num_samples - shift) / SUBSAMPLE_STRIDE < SUBSAMPLE_MIN_STRATA)
+        return calculate_interference_pwr(shift, array, num_samples, threshold);
+
+    float bound;
+    int32_t estimate = estimate_interference_pwr(shift, array, num_samples, threshold, &bound);
+    if (estimate == INT_MAX || estimate - bound > threshold)
     {
-        interference[shift] = calculate_interference_pwr(shift, array);
+        // A sample of the screened shifts is calculated exactly, to measure how often one below the threshold is missed
+        if (++counters->screened_shifts % SUBSAMPLE_AUDIT_INTERVAL)
+            return INT_MAX;
+        int32_t power = calculate_interference_pwr(shift, array, num_samples, threshold);
+        counters->audited_shifts++;
+        if (power != INT_MAX)
+            counters->screen_misses++;
+        return power;
     }
 
-    uint8_t peak_count = 0;
+    int32_t power = calculate_interference_pwr(shift, array, num_samples, threshold);
+    counters->exact_shifts++;
+    // An aborted calculation only shows the power exceeds the threshold
+    if (power == INT_MAX ? estimate + bound < threshold : abs(power - estimate) > bound)
+        counters->bound_violations++;
+    return power;
+}
+
+float calculate_freq_nsdf(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count)
+{
+    int16_t signal[NUM_SAMPLES];
+    uint8_t dc_bias = calculate_dc_bias(array, num_samples);
+    int32_t energy = 0;
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        signal[i] = array[i] - dc_bias;
+        energy += signal[i] * signal[i];
+    }
+
+    // Normalization term of shift 0, elements of both the original and the shifted signal
+    int32_t norm = 2 * energy;
+
+    bool passed_first_zero = false;
+    bool in_positive_region = false;
+    float key_max = 0, key_max_prev = 0, key_max_next = 0, prev = 1;
+    uint16_t key_max_shift = 0;
+
+    // Refined shifts and values of the key maxima, and the highest one
+    float key_shifts[PEAK_TRACKING_LIMIT], key_values[PEAK_TRACKING_LIMIT];
+    uint8_t key_count = 0;
+    float highest = 0;
+
+    for (uint16_t shift = 1; shift < shift_limit; shift++)
+    {
+        // Elements leaving the compared range
+        norm -= signal[shift - 1] * signal[shift - 1] + signal[num_samples - shift] * signal[num_samples - shift];
+        if (norm <= 0)
+            break;
+
+        int32_t correlation = 0;
+        for (uint16_t i = 0; i < num_samples - shift; i++)
+        {
+            correlation += signal[i] * signal[i + shift];
+        }
+        accumulate_samples(get_core_num(), num_samples - shift);
+        float nsdf = 2.0f * correlation / norm;
+        if (analysis_yield && shift % ANALYSIS_SLICE_SHIFTS == 0)
+            analysis_yield();
+
+        if (key_max_shift == shift - 1)
+            key_max_next = nsdf;
+
+        if (nsdf > 0 && prev <= 0)
+        {
+            in_positive_region = passed_first_zero;
+            key_max = 0;
+        }
+        else if (nsdf <= 0 && prev > 0)
+        {
+            passed_first_zero = true;
+
+            // A positive region has ended, store its key maximum
+            if (in_positive_region && key_count < PEAK_TRACKING_LIMIT)
+            {
+                float denominator = key_max_prev - 2 * key_max + key_max_next;
+                key_shifts[key_count] = key_max_shift;
+                if (denominator < 0)
+                    key_shifts[key_count] += 0.5f * (key_max_prev - key_max_next) / denominator;
+                key_values[key_count++] = key_max;
+                if (key_max > highest)
+                    highest = key_max;
+
+                // The region around twice the shift of the candidate has been evaluated, so the candidate is
+                // either confirmed there or the signal has no clear period
+                uint8_t candidate = 0;
+                while (key_values[candidate] < NSDF_K * highest)
+                    candidate++;
+                if (highest > NSDF_THRESHOLD && shift > 2 * key_shifts[candidate] + PEAK_SEARCH_RANGE)
+                    break;
+            }
+            in_positive_region = false;
+        }
+
+        if (in_positive_region && nsdf > key_max)
+        {
+            key_max = nsdf;
+            key_max_prev = prev;
+            key_max_shift = shift;
+        }
+        prev = nsdf;
+    }
+
+    *peak_count = 0;
+    if (highest <= NSDF_THRESHOLD)
+        return FS / (float)DEFAULT_VAL;
+
+    // The first key maximum within NSDF_K of the highest one is the period
+    uint8_t selected = 0;
+    while (key_values[selected] < NSDF_K * highest)
+        selected++;
+    *peak_count = 1;
+    for (uint8_t i = selected + 1; i < key_count; i++)
+    {
+        if (key_values[i] >= NSDF_K * highest && fabsf(key_shifts[i] - 2 * key_shifts[selected]) <= PEAK_SEARCH_RANGE)
+        {
+            *peak_count = 2;
+            break;
+        }
+    }
+    return FS / key_shifts[selected];
+}
+
+void freq_analysis_begin(struct freq_analysis_state *state, uint8_t array[], uint16_t num_samples, uint16_t shift_limit,
+                         int32_t initial_threshold)
+{
+    state->array = array;
+    state->num_samples = num_samples;
+    state->shift_limit = shift_limit;
+    state->initial_threshold = initial_threshold;
+    state->threshold = initial_threshold;
+    state->prior = 0;
+    state->prior_offset = 0;
+    state->shift = 0;
+    state->interference = interference_scratch[get_core_num()];
+
+    // The priors may be updated by the other core during the analysis
+    state->prior_count = prior_lag_count;
+    for (uint8_t prior = 0; prior < state->prior_count; prior++)
+    {
+        state->prior_lags[prior] = prior_lags[prior];
+    }
+
+    if (state->prior_count > 0)
+    {
+        // Mark all shifts as not calculated yet
+        for (uint16_t shift = 0; shift < shift_limit; shift++)
+        {
+            state->interference[shift] = INTERFERENCE_PENDING;
+        }
+    }
+}
+
+void freq_analysis_add_prior(struct freq_analysis_state *state, uint16_t lag)
+{
+    if (state->prior_count == LAG_PRIOR_CANDIDATES || lag >= state->shift_limit)
+        return;
+
+    if (state->prior_count == 0)
+    {
+        for (uint16_t shift = 0; shift < state->shift_limit; shift++)
+        {
+            state->interference[shift] = INTERFERENCE_PENDING;
+        }
+    }
+    state->prior_lags[state->prior_count++] = lag > LAG_PRIOR_BUCKET_WIDTH / 2 ? lag - LAG_PRIOR_BUCKET_WIDTH / 2 : 0;
+}
+
+// Stores the interference power of a shift in 16 bits
+static uint16_t store_interference(int32_t power)
+{
+    if (power == INT_MAX)
+        return INTERFERENCE_ABORTED;
+    return power < INTERFERENCE_SATURATION ? power : INTERFERENCE_SATURATION;
+}
+
+// Evaluates the next shift of the analysis, the prior lags first. Returns false if all shifts have been evaluated.
+static bool evaluate_next_shift(struct freq_analysis_state *state)
+{
+    uint16_t *interference = state->interference;
+
+    while (state->prior < state->prior_count)
+    {
+        uint16_t shift = state->prior_lags[state->prior] + state->prior_offset;
+        if (state->prior_offset >= LAG_PRIOR_BUCKET_WIDTH || shift >= state->shift_limit)
+        {
+            state->prior++;
+            state->prior_offset = 0;
+            if (state->prior == state->prior_count && state->threshold < state->initial_threshold / LAG_PRIOR_MIN_BOUND_DIVIDER)
+                state->threshold = state->initial_threshold / LAG_PRIOR_MIN_BOUND_DIVIDER;
+            continue;
+        }
+        state->prior_offset++;
+
+        int32_t power = calculate_interference_pwr(shift, state->array, state->num_samples, state->initial_threshold);
+        interference[shift] = store_interference(power);
+        if (power < state->threshold / LAG_PRIOR_BOUND_RATIO)
+            state->threshold = power * LAG_PRIOR_BOUND_RATIO;
+        return true;
+    }
+
+    if (state->shift >= state->shift_limit)
+        return false;
+
+    uint16_t shift = state->shift++;
+    if (state->prior_count == 0 || interference[shift] == INTERFERENCE_PENDING)
+        interference[shift] = store_interference(SUBSAMPLED_INTERFERENCE ? screen_interference_pwr(shift, state->array, state->num_samples, state->threshold)
+                                                                         : calculate_interference_pwr(shift, state->array, state->num_samples, state->threshold));
+    else if (interference[shift] > state->threshold)
+        interference[shift] = INTERFERENCE_ABORTED; // Priors were calculated with the initial threshold
+    return true;
+}
+
+bool freq_analysis_step(struct freq_analysis_state *state, uint16_t max_shifts)
+{
+    for (uint16_t i = 0; i < max_shifts; i++)
+    {
+        if (!evaluate_next_shift(state))
+            return true;
+    }
+    return state->prior == state->prior_count && state->shift >= state->shift_limit;
+}
+
+float freq_analysis_finish(struct freq_analysis_state *state, uint8_t *peak_count)
+{
+    *peak_count = 0;
     uint16_t peaks[PEAK_TRACKING_LIMIT];
-    calculate_peaks(peaks, &peak_count, interference);
+    calculate_peaks(peaks, peak_count, state->interference, state->shift_limit);
 
-    float avg_wavelength = calculate_avg_wavelength(peaks, peak_count);
+    float avg_wavelength = calculate_avg_wavelength(peaks, *peak_count);
     float frequency = FS / avg_wavelength;
     return frequency;
-}
\ No newline at end of file
+}
+
+float calculate_freq_with_threshold(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count,
+                                    int32_t initial_threshold)
+{
+    struct freq_analysis_state state;
+    freq_analysis_begin(&state, array, num_samples, shift_limit, initial_threshold);
+#if WAVELET_SEED
+    uint8_t votes, confidence;
+    float seed_frequency = find_wavelet_period(array, num_samples, shift_limit, &votes, &confidence);
+    if (votes >= WAVELET_SEED_VOTES)
+        freq_analysis_add_prior(&state, FS / seed_frequency + 0.5f);
+#endif
+    while (!freq_analysis_step(&state, ANALYSIS_SLICE_SHIFTS))
+    {
+        if (analysis_yield)
+            analysis_yield();
+    }
+    return freq_analysis_finish(&state, peak_count);
+}
+
+float calculate_freq(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count)
+{
+    return calculate_freq_with_threshold(array, num_samples, shift_limit, peak_count, interference_threshold);
+}
+
+float calculate_freq_harmonic_locked(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count,
+                                     float short_frequency, uint8_t short_peak_count)
+{
+    // Period of the fundamental or of a dominant harmonic, from the beginning of the window
+    *peak_count = short_peak_count;
+    if (short_frequency == 0)
+        short_frequency = calculate_freq_with_threshold(array, num_samples / HARMONIC_LOCK_WINDOW_DIVIDER,
+                                                        shift_limit / HARMONIC_LOCK_WINDOW_DIVIDER, peak_count,
+                                                        interference_threshold / HARMONIC_LOCK_THRESHOLD_DIVIDER);
+    if (*peak_count == 0)
+        return calculate_freq(array, num_samples, shift_limit, peak_count);
+    float period = FS / short_frequency;
+
+    // Only a multiple of the period matching a multiple of the fundamental cancels the whole signal out,
+    // the lowest one is selected. Powers are compared per element, as the overlap shrinks with the shift.
+    uint8_t dc_bias = calculate_dc_bias(array, num_samples);
+    uint32_t cancelled_pwr = calculate_signal_pwr(array, num_samples, dc_bias) * HARMONIC_LOCK_MAX_RESIDUE / num_samples;
+    uint8_t harmonic = 1;
+    while (1)
+    {
+        uint16_t shift = period * harmonic + 0.5f;
+        if (shift + harmonic + 1 >= shift_limit)
+            return calculate_freq(array, num_samples, shift_limit, peak_count);
+        int32_t interference_pwr = calculate_interference_pwr(shift, array, num_samples, INT_MAX);
+        if ((uint32_t)interference_pwr * 100 / (num_samples - shift) <= cancelled_pwr)
+            break;
+        if (++harmonic > HARMONIC_LOCK_MAX_HARMONIC)
+            return calculate_freq(array, num_samples, shift_limit, peak_count);
+    }
+
+    // The error of the short window period is multiplied by the harmonic number, search the shifts around.
+    // Candidates are center +/- harmonic (indices 1 to 2 * harmonic + 1), the outer two are only the parabola neighbours.
+    uint16_t center = period * harmonic + 0.5f;
+    int32_t interference[2 * HARMONIC_LOCK_MAX_HARMONIC + 3];
+    for (uint8_t i = 0; i < 2 * harmonic + 3; i++)
+    {
+        interference[i] = calculate_interference_pwr(center - harmonic - 1 + i, array, num_samples, INT_MAX);
+    }
+    // A tie is resolved in favour of the candidate closer to the center
+    uint8_t best = harmonic + 1;
+    for (uint8_t i = 1; i <= 2 * harmonic + 1; i++)
+    {
+        if (interference[i] < interference[best] ||
+            (interference[i] == interference[best] && abs(i - (harmonic + 1)) < abs(best - (harmonic + 1))))
+            best = i;
+    }
+
+    // Parabolic interpolation of the minimum
+    float shift = center - harmonic - 1 + best;
+    int32_t denominator = interference[best - 1] - 2 * interference[best] + interference[best + 1];
+    if (denominator > 0)
+        shift += 0.5f * (interference[best - 1] - interference[best + 1]) / denominator;
+    return FS / shift;
+}
+
+// Interference power per compared element, so the long shifts with fewer compared elements are not favoured
+static double normalized_interference(int32_t interference[], uint16_t shift, uint16_t num_samples)
+{
+    return (double)interference[shift] / (num_samples - shift);
+}
+
+float calculate_freq_reference(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count)
+{
+    int32_t interference[SHIFT_LIMIT];
+    double mean = 0;
+    for (uint16_t shift = 0; shift < shift_limit; shift++)
+    {
+        interference[shift] = calculate_interference_pwr(shift, array, num_samples, INT_MAX);
+        mean += normalized_interference(interference, shift, num_samples);
+        if (analysis_yield && shift % ANALYSIS_SLICE_SHIFTS == 0)
+            analysis_yield();
+    }
+    mean /= shift_limit;
+
+    *peak_count = 0;
+
+    // Skip the minimum around shift 0
+    uint16_t first_shift = 1;
+    while (first_shift < shift_limit - 1 && normalized_interference(interference, first_shift, num_samples) < mean)
+        first_shift++;
+
+    uint16_t best = first_shift;
+    for (uint16_t shift = first_shift; shift < shift_limit - 1; shift++)
+    {
+        if (normalized_interference(interference, shift, num_samples) < normalized_interference(interference, best, num_samples))
+            best = shift;
+    }
+    double min = normalized_interference(interference, best, num_samples);
+    if (!(min < mean))
+        return FS / (float)DEFAULT_VAL;
+    double tolerance = min + (mean - min) * REFERENCE_TOLERANCE / 100;
+
+    // The first local minimum within the tolerance, whose multiples are minima within the tolerance as well, is the period.
+    // Minima at the periods of the harmonics are rejected, as some of their multiples fall between those of the fundamental.
+    for (uint16_t shift = first_shift; shift < shift_limit - 1; shift++)
+    {
+        double value = normalized_interference(interference, shift, num_samples);
+        if (value > tolerance ||
+            value > normalized_interference(interference, shift - 1, num_samples) ||
+            value > normalized_interference(interference, shift + 1, num_samples))
+            continue;
+
+        bool consistent = true;
+        uint8_t confirmed = 1;
+        for (uint8_t harmonic = 2; harmonic <= REFERENCE_HARMONICS && consistent; harmonic++)
+        {
+            // The error of the shift is multiplied by the harmonic number
+            uint16_t multiple = shift * harmonic;
+            if (multiple + harmonic >= shift_limit)
+                break;
+            uint16_t multiple_min = multiple - harmonic;
+            for (uint16_t i = multiple - harmonic; i <= multiple + harmonic; i++)
+            {
+                if (normalized_interference(interference, i, num_samples) < normalized_interference(interference, multiple_min, num_samples))
+                    multiple_min = i;
+            }
+            if (normalized_interference(interference, multiple_min, num_samples) > tolerance)
+                consistent = false;
+            else
+                confirmed++;
+        }
+        if (!consistent)
+            continue;
+
+        // Parabolic interpolation of the minimum
+        double prev = normalized_interference(interference, shift - 1, num_samples);
+        double next = normalized_interference(interference, shift + 1, num_samples);
+        double denominator = prev - 2 * value + next;
+        double period = shift;
+        if (denominator > 0)
+            period += 0.5 * (prev - next) / denominator;
+
+        *peak_count = confirmed;
+        return FS / period;
+    }
+    return FS / (float)DEFAULT_VAL;
+}
+
+// Records the first extremum of each polarity after a zero crossing, if high enough and not too close to the previous one
+static uint8_t find_extrema(int16_t signal[], uint16_t length, int16_t threshold, uint16_t tolerance,
+                            uint16_t minima[], uint16_t maxima[], uint8_t *maximum_count)
+{
+    uint8_t minimum_count = 0;
+    int32_t last_minimum = -tolerance - 1;
+    int32_t last_maximum = -tolerance - 1;
+    bool find_minimum = false;
+    bool find_maximum = false;
+    *maximum_count = 0;
+
+    for (uint16_t i = 2; i < length; i++)
+    {
+        if (signal[i - 1] <= 0 && signal[i] > 0)
+            find_maximum = true;
+        if (signal[i - 1] >= 0 && signal[i] < 0)
+            find_minimum = true;
+
+        int16_t prev_slope = signal[i - 1] - signal[i - 2];
+        int16_t slope = signal[i] - signal[i - 1];
+        if (find_minimum && prev_slope < 0 && slope >= 0 && -signal[i - 1] >= threshold &&
+            i - 1 > last_minimum + tolerance && minimum_count < WAVELET_MAX_EXTREMA)
+        {
+            minima[minimum_count++] = i - 1;
+            last_minimum = i - 1;
+            find_minimum = false;
+        }
+        if (find_maximum && prev_slope > 0 && slope <= 0 && signal[i - 1] >= threshold &&
+            i - 1 > last_maximum + tolerance && *maximum_count < WAVELET_MAX_EXTREMA)
+        {
+            maxima[(*maximum_count)++] = i - 1;
+            last_maximum = i - 1;
+            find_maximum = false;
+        }
+    }
+    return minimum_count;
+}
+
+// Adds the votes of the distances from each extremum to the following ones
+static void vote_distances(uint8_t votes[], uint16_t extrema[], uint8_t count, uint16_t max_distance)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        for (uint8_t j = i + 1; j <= i + WAVELET_NEIGHBOURS && j < count; j++)
+        {
+            uint16_t distance = extrema[j] - extrema[i];
+            if (distance <= max_distance && votes[distance] < UINT8_MAX)
+                votes[distance]++;
+        }
+    }
+}
+
+// Finds the period of the wavelet engine, see calculate_freq_wavelet. Returns the frequency, the votes of the period,
+// and its confidence as a peak count
+static float find_wavelet_period(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *period_votes,
+                                 uint8_t *peak_count)
+{
+    int16_t *signal = wavelet_signal[get_core_num()];
+    uint8_t *votes = wavelet_votes[get_core_num()];
+    uint16_t minima[WAVELET_MAX_EXTREMA];
+    uint16_t maxima[WAVELET_MAX_EXTREMA];
+
+    uint8_t dc_bias = calculate_dc_bias(array, num_samples);
+    int16_t amplitude = 0;
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        signal[i] = array[i] - dc_bias;
+        if (abs(signal[i]) > amplitude)
+            amplitude = abs(signal[i]);
+    }
+    // Extrema below 3/4 of the peak amplitude are ignored
+    int16_t threshold = (amplitude + (amplitude << 1)) >> 2;
+
+    *period_votes = 0;
+    *peak_count = 0;
+    uint16_t length = num_samples;
+    uint32_t prev_mode = 0; // Mode distance of the previous level, in 1/2^WAVELET_FRACTION_BITS samples
+    uint8_t prev_votes = 0;
+    uint16_t prev_extrema = 0;
+    uint16_t extrema = 0;
+    for (uint8_t level = 0; level < WAVELET_LEVELS && length >= 2; level++)
+    {
+        uint16_t tolerance = (FS / WAVELET_MAX_FREQ) >> level;
+        uint16_t max_distance = (shift_limit >> level) < length ? shift_limit >> level : length - 1;
+
+        uint8_t maximum_count;
+        uint8_t minimum_count = find_extrema(signal, length, threshold, tolerance, minima, maxima, &maximum_count);
+        if (minimum_count == 0 && maximum_count == 0)
+            break;
+        prev_extrema = extrema;
+        extrema = minimum_count + maximum_count;
+
+        for (uint16_t distance = 0; distance <= max_distance; distance++)
+        {
+            votes[distance] = 0;
+        }
+        vote_distances(votes, minima, minimum_count, max_distance);
+        vote_distances(votes, maxima, maximum_count, max_distance);
+
+        // Distance with the most votes within the tolerance, a tie with its double is resolved in favour of the double
+        uint16_t window = 0;
+        for (uint16_t distance = 0; distance < tolerance && distance <= max_distance; distance++)
+        {
+            window += votes[distance];
+        }
+        uint16_t best_window = 0;
+        uint16_t best_distance = 0;
+        for (uint16_t distance = 0; distance <= max_distance; distance++)
+        {
+            if (distance + tolerance <= max_distance)
+                window += votes[distance + tolerance];
+            if (distance > tolerance)
+                window -= votes[distance - tolerance - 1];
+
+            if (window > best_window || (window == best_window && window > 0 && distance == best_distance << 1))
+            {
+                best_window = window;
+                best_distance = distance;
+            }
+        }
+        if (best_window == 0)
+            break;
+
+        // Mode distance averaged over the window
+        uint32_t weighted_sum = 0;
+        for (uint16_t distance = best_distance > tolerance ? best_distance - tolerance : 0;
+             distance <= best_distance + tolerance && distance <= max_distance; distance++)
+        {
+            weighted_sum += (uint32_t)distance * votes[distance];
+        }
+        uint32_t mode = ((weighted_sum << WAVELET_FRACTION_BITS) + best_window / 2) / best_window;
+
+        // Two consecutive levels agree on the period
+        if (prev_mode > 0 && abs((int32_t)(mode << 1) - (int32_t)prev_mode) <= tolerance << (WAVELET_FRACTION_BITS + 1))
+        {
+            // A tone has one extremum per half period, the extrema of noise crowd at the tolerance instead
+            uint32_t expected_extrema = ((uint32_t)length << (WAVELET_FRACTION_BITS + 2)) / prev_mode;
+            bool periodic = prev_extrema * 100 <= expected_extrema * WAVELET_MAX_EXTREMA_EXCESS;
+            *period_votes = prev_votes;
+            *peak_count = periodic && prev_votes >= WAVELET_CONFIDENT_VOTES ? MIN_CONFIDENT_PEAKS : 1;
+            return (float)(FS << WAVELET_FRACTION_BITS) / (prev_mode << (level - 1));
+        }
+        prev_mode = mode;
+        prev_votes = best_window < UINT8_MAX ? best_window : UINT8_MAX;
+
+        // Haar approximation, the signal is decimated by averaging the sample pairs
+        length >>= 1;
+        for (uint16_t i = 0; i < length; i++)
+        {
+            signal[i] = (signal[i << 1] + signal[(i << 1) + 1]) >> 1;
+        }
+    }
+    return FS / (float)DEFAULT_VAL;
+}
+
+float calculate_freq_wavelet(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count)
+{
+    uint8_t votes;
+    return find_wavelet_period(array, num_samples, shift_limit, &votes, peak_count);
+}
+
+const freq_estimator freq_engines[ENGINE_COUNT] = {
+    [ENGINE_INTERFERENCE] = calculate_freq,
+    [ENGINE_NSDF] = calculate_freq_nsdf,
+    [ENGINE_REFERENCE] = calculate_freq_reference,
+    [ENGINE_WAVELET] = calculate_freq_wavelet,
+};
\ No newline at end of file
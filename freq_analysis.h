@@ -3,9 +3,181 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <limits.h>
+#include "pico/stdlib.h"
 #include "macros.h"
 
+/**
+ * @brief Interference power above which calculate_interference_pwr aborts.
+ *
+ * Initialised with INTERFERENCE_THRESHOLD, may be raised by the calibration for noisy units.
+ */
+extern int32_t interference_threshold;
+
+/**
+ * @brief Shifts evaluated by calculate_freq before the others, most likely first.
+ *
+ * Each entry is the first of LAG_PRIOR_BUCKET_WIDTH consecutive shifts. Filled from the field-learned histogram of periods.
+ */
+extern uint16_t prior_lags[LAG_PRIOR_CANDIDATES];
+extern uint8_t prior_lag_count;
+
+/**
+ * @brief Called by calculate_freq, calculate_freq_nsdf and calculate_freq_reference between the slices of
+ * ANALYSIS_SLICE_SHIFTS shifts, if not NULL.
+ *
+ * Lets the single core build (SINGLE_CORE) refresh the display while a frame is analyzed, and core 1 running
+ * the shadow engine (SHADOW_MODE) respond to a park request.
+ */
+extern void (*analysis_yield)(void);
+
+/**
+ * @brief Number of samples accumulated by calculate_interference_pwr and calculate_freq_nsdf since power-up, per core.
+ *
+ * Kept in 64 bits, as a 32-bit counter wraps after about 10 minutes of continuous analysis.
+ */
+extern uint64_t accumulated_samples[NUM_CORES];
+
+/**
+ * @brief Reads the accumulated samples of the given core, from either core.
+ *
+ * The M0+ writes the 64-bit counter in two halves, so the other core reads it under a per-core sequence counter,
+ * and retries while an update is in progress.
+ *
+ * @param core The core whose counter is read.
+ *
+ * @return The number of samples accumulated by the core.
+ */
+uint64_t read_accumulated_samples(uint core);
+
+/**
+ * @brief Counters of the subsampled interference screening (SUBSAMPLED_INTERFERENCE).
+ */
+struct subsample_stats
+{
+    uint32_t screened_shifts;  // Shifts rejected from the estimate alone
+    uint32_t exact_shifts;     // Shifts whose confidence interval reached the threshold, calculated exactly
+    uint32_t bound_violations; // Exactly calculated shifts deviating from the estimate by more than the bound
+    uint32_t audited_shifts;   // Screened shifts calculated exactly anyway, one per SUBSAMPLE_AUDIT_INTERVAL
+    uint32_t screen_misses;    // Audited shifts whose power turned out not to exceed the threshold
+};
+
+extern struct subsample_stats subsample_stats[NUM_CORES];
+
+/**
+ * @brief Counters of calculate_interference_pwr, per core.
+ */
+struct interference_stats
+{
+    uint32_t calculations; // Shifts calculated
+    uint32_t aborts;       // Calculations aborted on exceeding the threshold
+};
+
+extern struct interference_stats interference_stats[NUM_CORES];
+
+// The interference powers searched for peaks are stored in 16 bits. Powers below the threshold fit, as the calibrated
+// threshold stays far below the saturation, the aborted and not yet calculated shifts are marked with the values above it.
+#define INTERFERENCE_ABORTED UINT16_MAX
+#define INTERFERENCE_PENDING (UINT16_MAX - 1)
+#define INTERFERENCE_SATURATION (UINT16_MAX - 2)
+
+// Division by the SMA width is replaced by multiplication by its reciprocal, scaled by 2^SMA_RECIPROCAL_SHIFT.
+// The result is exact for any sum of up to 256 8-bit samples, and the product never exceeds 32 bits.
+#define SMA_RECIPROCAL_SHIFT 24
+#define SMA_RECIPROCAL (((1u << SMA_RECIPROCAL_SHIFT) + SMA_WIDTH) / (SMA_WIDTH + 1))
+
+// The mode distance of the wavelet engine is averaged in fixed point, with WAVELET_FRACTION_BITS fractional bits.
+#define WAVELET_FRACTION_BITS 4
+
+// When resampling, the ADC sample position of each output sample advances by ADC_FS / FS, in 16.16 fixed point.
+// The rounding of the step changes the output rate by less than 2^-17 relative, below 0.02 cents.
+#define RESAMPLE_FRACTION_BITS 16
+#define RESAMPLE_STEP ((uint32_t)((((uint64_t)ADC_FS << RESAMPLE_FRACTION_BITS) + FS / 2) / FS))
+// Number of interpolation phases between two consecutive SMA outputs is 2^RESAMPLE_PHASE_BITS
+#define RESAMPLE_PHASE_BITS 8
+
+// Number of ADC samples needed to produce num_samples smoothed samples at FS
+#if ADC_FS == FS
+#define CAPTURE_LENGTH(num_samples) ((num_samples) + SMA_WIDTH)
+#else
+#define CAPTURE_LENGTH(num_samples) ((uint16_t)(((uint32_t)(num_samples) * ADC_FS + FS - 1) / FS + SMA_WIDTH + 1))
+#endif
+
+// Frequency estimation engines
+#define ENGINE_INTERFERENCE 0 // calculate_freq
+#define ENGINE_NSDF 1         // calculate_freq_nsdf
+#define ENGINE_REFERENCE 2    // calculate_freq_reference, too slow for the primary engine
+#define ENGINE_WAVELET 3      // calculate_freq_wavelet
+#define ENGINE_COUNT 4
+
+/**
+ * @brief Common signature of the frequency estimation engines, see calculate_freq.
+ */
+typedef float (*freq_estimator)(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count);
+
+/**
+ * @brief Frequency estimation engines, indexed by ENGINE_*.
+ */
+extern const freq_estimator freq_engines[ENGINE_COUNT];
+
+// Preconditioning modes
+#define PRECONDITIONING_NONE 0
+#define PRECONDITIONING_CENTER_CLIP 1 // Deviations from DC bias are reduced by the clip level, smaller ones are zeroed
+#define PRECONDITIONING_THREE_LEVEL 2 // Deviations exceeding the clip level become +/-THREE_LEVEL_AMPLITUDE, others are zeroed
+
+/**
+ * @brief State of the preconditioning applied while smoothing.
+ *
+ * The clip level is derived from the peak amplitude of the previous frame, so that the preconditioning
+ * can be applied in the same pass as the smoothing.
+ */
+struct preconditioning
+{
+    uint8_t dc_bias;        // DC bias of the input signal
+    uint8_t clip_level;     // Deviations from DC bias within the clip level are zeroed
+    uint8_t peak_amplitude; // Max deviation from DC bias of the smoothed frame, updated during the smoothing
+    uint32_t signal_pwr;    // Power of the smoothed frame before preconditioning, updated during the smoothing
+};
+
+/**
+ * @brief Applies the preconditioning selected by PRECONDITIONING to a single smoothed sample.
+ *
+ * Removing the low-amplitude part of the signal, which is dominated by the harmonics, deepens and narrows
+ * the interference minima at the fundamental period.
+ *
+ * @param sample The smoothed sample.
+ * @param pre Pointer to the preconditioning state, its peak amplitude and signal power are updated.
+ *
+ * @return The preconditioned sample.
+ */
+static inline uint8_t precondition_sample(uint8_t sample, struct preconditioning *pre)
+{
+    int16_t deviation = sample - pre->dc_bias;
+    uint8_t amplitude = abs(deviation);
+    pre->signal_pwr += amplitude;
+    if (amplitude > pre->peak_amplitude)
+        pre->peak_amplitude = amplitude;
+
+    if (amplitude <= pre->clip_level)
+        return pre->dc_bias;
+#if PRECONDITIONING == PRECONDITIONING_THREE_LEVEL
+    return deviation > 0 ? pre->dc_bias + THREE_LEVEL_AMPLITUDE : pre->dc_bias - THREE_LEVEL_AMPLITUDE;
+#else
+    return deviation > 0 ? sample - pre->clip_level : sample + pre->clip_level;
+#endif
+}
+
+/**
+ * @brief Prepares the preconditioning state for the next frame.
+ *
+ * The clip level is set to CLIP_RATIO percent of the peak amplitude of the last frame, the peak and the power are reset.
+ *
+ * @param pre Pointer to the preconditioning state.
+ * @param dc_bias The DC bias of the input signal.
+ */
+void update_preconditioning(struct preconditioning *pre, uint8_t dc_bias);
+
 /**
  * @brief Finds the index of the minimum value within a specified range of elements.
  *
@@ -19,7 +191,7 @@
  *
  * @return The index of the minimum value in the specified range.
  */
-uint16_t min_in_range(int32_t array[], uint16_t begin_index, uint16_t range);
+uint16_t min_in_range(uint16_t array[], uint16_t begin_index, uint16_t range);
 
 /**
  * @brief Identifies local minima in the provided array within a predefined search range.
@@ -30,9 +202,10 @@ uint16_t min_in_range(int32_t array[], uint16_t begin_index, uint16_t range);
  *
  * @param peaks Pointer to an array to store the indices of identified peaks.
  * @param peak_count Pointer to the variable holding the current count of peaks.
- * @param array The input array in which peaks are to be found.
+ * @param array The interference powers in which peaks are to be found, see INTERFERENCE_ABORTED.
+ * @param shift_limit The number of elements of the array to search, at most SHIFT_LIMIT.
  */
-void calculate_peaks(uint16_t peaks[], uint8_t *peak_count, int32_t array[]);
+void calculate_peaks(uint16_t peaks[], uint8_t *peak_count, uint16_t array[], uint16_t shift_limit);
 
 /**
  * @brief Calculates the average wavelength based on identified peaks.
@@ -63,32 +236,304 @@ float calculate_avg_wavelength(uint16_t peaks[], uint8_t peak_count);
  */
 uint16_t calculate_sma(uint16_t index, uint8_t array[]);
 
+/**
+ * @brief Applies Simple Moving Average (SMA) smoothing to a series of samples.
+ *
+ * This function produces the same output as calculate_sma called for each index, but keeps a running sum,
+ * so only one sample is added and one subtracted per output, and the division is replaced by a multiplication.
+ * Unless PRECONDITIONING is PRECONDITIONING_NONE, each output is also preconditioned in the same pass.
+ * The source array must hold num_samples + SMA_WIDTH elements. Each output only depends on the samples at or after
+ * its index, and the sample leaving the running sum is kept aside, so the destination may be the source array itself.
+ *
+ * @param dst Pointer to an array receiving the smoothed samples.
+ * @param src Pointer to an array containing the samples to smooth.
+ * @param num_samples The number of samples to produce.
+ * @param pre Pointer to the preconditioning state, or NULL to leave the samples unconditioned (e.g. for the calibration).
+ */
+void smooth_samples(uint8_t dst[], uint8_t src[], uint16_t num_samples, struct preconditioning *pre);
+
+/**
+ * @brief Applies Simple Moving Average (SMA) smoothing to a series of samples captured at ADC_FS, resampling them to FS.
+ *
+ * This is a polyphase resampler whose prototype filter is the SMA window: running sums of the windows starting at
+ * two consecutive ADC samples are kept, and each output is linearly interpolated between them, with the phase
+ * quantized to 2^RESAMPLE_PHASE_BITS steps. The SMA also serves as the anti-aliasing filter when downsampling.
+ * Unless PRECONDITIONING is PRECONDITIONING_NONE, each output is also preconditioned in the same pass.
+ * The source array must hold CAPTURE_LENGTH(num_samples) elements. If ADC_FS is not lower than FS, each output only
+ * depends on the samples at or after its index, so the destination may be the source array itself.
+ *
+ * @param dst Pointer to an array receiving the smoothed samples.
+ * @param src Pointer to an array containing the samples captured at ADC_FS.
+ * @param num_samples The number of samples to produce.
+ * @param pre Pointer to the preconditioning state, or NULL to leave the samples unconditioned (e.g. for the calibration).
+ */
+void resample_samples(uint8_t dst[], uint8_t src[], uint16_t num_samples, struct preconditioning *pre);
+
+/**
+ * @brief Calculates the DC bias of the input signal.
+ *
+ * @param array The input array.
+ * @param num_samples The number of elements of the array.
+ *
+ * @return The mean of the elements of the array.
+ */
+uint8_t calculate_dc_bias(uint8_t array[], uint16_t num_samples);
+
+/**
+ * @brief Calculates the power of the input signal.
+ *
+ * This function accumulates the absolute deviations of the elements from the DC bias.
+ * The result is expressed in the same units as calculate_interference_pwr, so both can be compared.
+ *
+ * @param array The input array.
+ * @param num_samples The number of elements of the array.
+ * @param dc_bias The DC bias of the input signal.
+ *
+ * @return The calculated power of the signal.
+ */
+uint32_t calculate_signal_pwr(uint8_t array[], uint16_t num_samples, uint8_t dc_bias);
+
 /**
  * @brief Calculates the power of the input signal when interfered with its shifted version.
  *
  * This function computes the amplitude difference between elements of the array and their
  * corresponding shifted elements. It iterates through the array, accumulating the
- * absolute differences. If the accumulated amplitude difference exceeds the predefined
+ * absolute differences. If the accumulated amplitude difference exceeds the provided
  * threshold, the function returns INT_MAX to prevent excessive computation.
  * Note that to be mathematicaly correct, the return value should be devided by the number
  * of compared elements to represent signal power. In this case it would only add unnecessary division.
  *
  * @param shift The number of positions to shift the array for interference calculation.
  * @param array The input array for interference calculation.
+ * @param num_samples The number of elements of the array.
+ * @param threshold The power above which the calculation is aborted.
  *
  * @return The calculated powere of interfered signal or INT_MAX if the threshold is exceeded.
  */
-int32_t calculate_interference_pwr(int shift, uint8_t array[]);
+int32_t calculate_interference_pwr(int shift, uint8_t array[], uint16_t num_samples, int32_t threshold);
+
+/**
+ * @brief Estimates the power of the input signal when interfered with its shifted version, from a subset of the elements.
+ *
+ * The compared range is split into strata of SUBSAMPLE_STRIDE elements, and a single element is compared in each one,
+ * at a fixed pseudo-random position. The sum is scaled to the whole range. The confidence bound is SUBSAMPLE_CONFIDENCE
+ * standard errors of the scaled sum, estimated from the variance of the compared differences.
+ * The estimation is aborted as soon as the scaled sum exceeds SUBSAMPLE_ABORT_RATIO times the threshold.
+ *
+ * @param shift The number of positions to shift the array for interference calculation.
+ * @param array The input array for interference calculation.
+ * @param num_samples The number of elements of the array.
+ * @param threshold The power above which the calculation is aborted.
+ * @param bound Pointer to the variable receiving the confidence bound (not set if the estimation is aborted).
+ *
+ * @return The estimated power of interfered signal or INT_MAX if the estimation is aborted.
+ */
+int32_t estimate_interference_pwr(int shift, uint8_t array[], uint16_t num_samples, int32_t threshold, float *bound);
 
 /**
  * @brief Estimates the base frequency of the input signal using interference analysis.
  *
  * This function analyzes the input array by searching for shift values, that produce destructive interference.
+ * Shorter windows and lag ranges reduce the computation, but limit the lowest detectable frequency.
+ * The prior lags are evaluated first. If any of them produces destructive interference, the threshold for the remaining
+ * shifts is lowered to LAG_PRIOR_BOUND_RATIO times its power, so most of them are aborted sooner.
+ * The powers are kept in a per-core scratch array in 16 bits (see INTERFERENCE_SATURATION), so the analysis
+ * state is small and the array is not allocated on the stack.
+ * With SUBSAMPLED_INTERFERENCE, the remaining shifts are first estimated from a subset of the elements
+ * (estimate_interference_pwr), and only those whose confidence interval reaches the threshold are calculated exactly.
+ * One per SUBSAMPLE_AUDIT_INTERVAL screened shifts is calculated exactly too, counting the ones the screening missed.
+ * With WAVELET_SEED, the period found by calculate_freq_wavelet is evaluated first too, if it has enough votes.
+ *
+ * @param array The input array containing the signal for frequency analysis.
+ * @param num_samples The number of elements of the array (analysis window length), at most NUM_SAMPLES.
+ * @param shift_limit Max phase shift to investigate, lower than num_samples and at most SHIFT_LIMIT.
+ * @param peak_count Pointer to the variable receiving the number of identified peaks (0 if none was found).
+ *
+ * @return The estimated base frequency of the input signal.
+ */
+float calculate_freq(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count);
+
+/**
+ * @brief Estimates the base frequency of the input signal using interference analysis, with a given threshold.
+ *
+ * This function is calculate_freq with the threshold passed explicitly instead of interference_threshold,
+ * so shorter windows can be analyzed with a tighter threshold, also concurrently on both cores.
+ *
+ * @param array The input array containing the signal for frequency analysis.
+ * @param num_samples The number of elements of the array (analysis window length), at most NUM_SAMPLES.
+ * @param shift_limit Max phase shift to investigate, lower than num_samples and at most SHIFT_LIMIT.
+ * @param peak_count Pointer to the variable receiving the number of identified peaks (0 if none was found).
+ * @param initial_threshold The power above which the interference calculation is aborted.
+ *
+ * @return The estimated base frequency of the input signal.
+ */
+float calculate_freq_with_threshold(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count,
+                                    int32_t initial_threshold);
+
+/**
+ * @brief Estimates the base frequency of a low note from the period of its dominant harmonic.
+ *
+ * The 2nd and 3rd harmonics of low strings are often stronger than the fundamental, and their periods fit a window
+ * HARMONIC_LOCK_WINDOW_DIVIDER times shorter. calculate_freq finds the period of the fundamental or of such a harmonic
+ * in the beginning of the window, with the threshold tightened by HARMONIC_LOCK_THRESHOLD_DIVIDER, unless the caller
+ * passes the result of the same analysis (the provisional one of DUAL_WINDOW).
+ * Its multiples up to HARMONIC_LOCK_MAX_HARMONIC are then tested over the whole window. Only a multiple of the
+ * fundamental period cancels the whole signal out, so the lowest multiple leaving less than HARMONIC_LOCK_MAX_RESIDUE
+ * percent of the signal is taken as the fundamental, and refined by searching the shifts within the harmonic number
+ * on either side of it, with parabolic interpolation. So instead of scanning all the shifts up to shift_limit,
+ * only the short window range and a few long shifts are calculated.
+ * If no period is found in the beginning of the window, or none of its multiples cancels the signal out,
+ * the function falls back to calculate_freq.
+ *
+ * @param array The input array containing the signal for frequency analysis.
+ * @param num_samples The number of elements of the array (analysis window length), at most NUM_SAMPLES.
+ * @param shift_limit Max phase shift to investigate, lower than num_samples and at most SHIFT_LIMIT.
+ * @param peak_count Pointer to the variable receiving the number of peaks identified in the beginning of the window
+ *                   (0 if none was found in the whole window either).
+ * @param short_frequency The frequency already found in the beginning of the window, with the same window, shift limit
+ *                        and threshold, or 0 to analyze it here.
+ * @param short_peak_count The number of peaks of short_frequency, ignored if it is 0.
+ *
+ * @return The estimated base frequency of the input signal.
+ */
+float calculate_freq_harmonic_locked(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count,
+                                     float short_frequency, uint8_t short_peak_count);
+
+/**
+ * @brief Estimates the base frequency of the input signal using the Normalized Square Difference Function (NSDF).
+ *
+ * This function implements the McLeod Pitch Method. For each shift, the autocorrelation of the input is normalized
+ * by the energy of the compared elements, so the result lies in range <-1, 1> regardless of the signal amplitude.
+ * The normalization term is updated incrementally, by removing the two elements that leave the compared range.
+ * Only the highest value of each positive region (key maximum) is considered. The first key maximum reaching
+ * NSDF_K times the highest one is selected, which rejects the subharmonics without a separate filtering step,
+ * and signals whose highest key maximum does not exceed NSDF_THRESHOLD are treated as unpitched.
+ * The scan is terminated once the region around twice the shift of the candidate has been evaluated.
+ * The key maxima are refined with parabolic interpolation.
+ *
+ * @param array The input array containing the signal for frequency analysis.
+ * @param num_samples The number of elements of the array (analysis window length), at most NUM_SAMPLES.
+ * @param shift_limit Max phase shift to investigate, lower than num_samples.
+ * @param peak_count Pointer to the variable receiving 0 if the signal is unpitched, 2 if the selected key maximum
+ *                   is confirmed by another one reaching NSDF_K times the highest at twice its shift, 1 otherwise.
+ *
+ * @return The estimated base frequency of the input signal.
+ */
+float calculate_freq_nsdf(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count);
+
+/**
+ * @brief State of an interference analysis performed in slices, see freq_analysis_step.
+ */
+struct freq_analysis_state
+{
+    uint8_t *array;
+    uint16_t num_samples;
+    uint16_t shift_limit;
+    int32_t initial_threshold;
+    int32_t threshold;                          // Lowered by the priors
+    uint8_t prior_count;                        // Snapshot of prior_lag_count and prior_lags from the beginning
+    uint16_t prior_lags[LAG_PRIOR_CANDIDATES];
+    uint8_t prior;                              // Next prior to evaluate...
+    uint8_t prior_offset;                       // ...and the next shift of its bucket
+    uint16_t shift;                             // Next shift to evaluate once the priors are done
+    uint16_t *interference;                     // Scratch array of the core running the analysis
+};
+
+/**
+ * @brief Starts the analysis of calculate_freq_with_threshold, without evaluating any shift.
+ *
+ * The analysis is resumable: the shifts are evaluated by freq_analysis_step in bounded slices, so the caller can
+ * service other tasks in between, and the result is read with freq_analysis_finish. The array must not be modified
+ * until the analysis is finished. The interference powers are kept in the scratch array of the calling core,
+ * so only one analysis can be in progress per core, and it must be stepped and finished on that core.
+ *
+ * @param state The state of the analysis to initialise.
+ * @param array The input array containing the signal for frequency analysis.
+ * @param num_samples The number of elements of the array (analysis window length), at most NUM_SAMPLES.
+ * @param shift_limit Max phase shift to investigate, lower than num_samples and at most SHIFT_LIMIT.
+ * @param initial_threshold The power above which the interference calculation is aborted.
+ */
+void freq_analysis_begin(struct freq_analysis_state *state, uint8_t array[], uint16_t num_samples, uint16_t shift_limit,
+                         int32_t initial_threshold);
+
+/**
+ * @brief Evaluates at most max_shifts shifts of the analysis started with freq_analysis_begin.
+ *
+ * Each shift costs at most num_samples - shift accumulated samples, so the duration of a step is bounded.
+ *
+ * @param state The state of the analysis.
+ * @param max_shifts The max number of shifts to evaluate.
+ *
+ * @return True if all shifts have been evaluated and the result can be read with freq_analysis_finish.
+ */
+bool freq_analysis_step(struct freq_analysis_state *state, uint16_t max_shifts);
+
+/**
+ * @brief Finds the peaks of the evaluated shifts and returns the estimated base frequency.
+ *
+ * @param state The state of the analysis, after freq_analysis_step returned true.
+ * @param peak_count Pointer to the variable receiving the number of identified peaks (0 if none was found).
+ *
+ * @return The estimated base frequency of the input signal.
+ */
+float freq_analysis_finish(struct freq_analysis_state *state, uint8_t *peak_count);
+
+/**
+ * @brief Adds a lag to the priors of the analysis started with freq_analysis_begin, before any step.
+ *
+ * The LAG_PRIOR_BUCKET_WIDTH shifts centered on the lag are evaluated first, like the learned priors (see prior_lags).
+ * The lag is ignored if all LAG_PRIOR_CANDIDATES priors are taken, or if it is not lower than the shift limit.
+ *
+ * @param state The state of the analysis.
+ * @param lag The expected period, in samples.
+ */
+void freq_analysis_add_prior(struct freq_analysis_state *state, uint16_t lag);
+
+/**
+ * @brief Estimates the base frequency of the input signal with an exhaustive interference analysis, as a reference.
+ *
+ * This function is meant to label frames for the evaluation of the other engines (see SHADOW_MODE), not to run per frame.
+ * The interference power of every shift up to shift_limit is calculated without aborting, and normalized by the number
+ * of compared elements. Local minima within REFERENCE_TOLERANCE percent of the range between the lowest and the mean
+ * interference are candidates, and the first one whose multiples up to REFERENCE_HARMONICS are candidates too
+ * is selected, which rejects the periods of harmonics. The selected shift is refined with parabolic interpolation,
+ * in double precision.
+ *
+ * @param array The input array containing the signal for frequency analysis.
+ * @param num_samples The number of elements of the array (analysis window length), at most NUM_SAMPLES.
+ * @param shift_limit Max phase shift to investigate, lower than num_samples and at most SHIFT_LIMIT.
+ * @param peak_count Pointer to the variable receiving the number of multiples of the selected shift confirming it,
+ *                   including itself (0 if no period was found).
+ *
+ * @return The estimated base frequency of the input signal.
+ */
+float calculate_freq_reference(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count);
+
+/**
+ * @brief Estimates the base frequency of the input signal from the distances of its extrema, over Haar decimations.
+ *
+ * This is the Larson-Maddox wavelet pitch detector in integer arithmetic. At each level, the first extremum of each
+ * polarity after a zero crossing is taken, if it reaches 3/4 of the peak amplitude and lies farther than the tolerance
+ * (FS / WAVELET_MAX_FREQ samples, halved per level) from the previous one. The distances from each extremum to the
+ * WAVELET_NEIGHBOURS following ones vote for the period, and the mode is the distance with the most votes within
+ * the tolerance. Once the mode of a level is half of the mode of the previous one, the previous one is the period.
+ * Otherwise the signal is decimated by averaging the sample pairs (the Haar approximation), and the next level is searched.
+ * The cost is O(num_samples): the extrema search and the decimation take adds, compares and shifts per sample,
+ * and the mode average of each level multiplies the votes of the distances within the tolerance.
+ * The signal and the votes are kept in static per-core arrays, as the engine also seeds calculate_freq.
+ * The votes grow with the window and the frequency, and noise collects as many as a tone, so they are not
+ * a peak count. The result is confident (MIN_CONFIDENT_PEAKS peaks) if the period has at least WAVELET_CONFIDENT_VOTES
+ * votes and its level has at most WAVELET_MAX_EXTREMA_EXCESS percent of the two extrema per period of a tone,
+ * otherwise it is reported as a single peak.
  *
  * @param array The input array containing the signal for frequency analysis.
+ * @param num_samples The number of elements of the array (analysis window length), at most NUM_SAMPLES.
+ * @param shift_limit Max period to detect, lower than num_samples.
+ * @param peak_count Pointer to the variable receiving MIN_CONFIDENT_PEAKS for a confident result, 1 otherwise
+ *                   (0 if no period was found).
  *
  * @return The estimated base frequency of the input signal.
  */
-float calculate_freq(uint8_t array[]);
+float calculate_freq_wavelet(uint8_t array[], uint16_t num_samples, uint16_t shift_limit, uint8_t *peak_count);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,442 @@
+/**
+ * Inter-core handoff microbenchmark
+ *
+ * This program runs on the same Raspberry Pi Pico board as the tuner, and measures the mechanisms that can pass
+ * the results (or the samples) from core 0 to core 1:
+ * - SIO FIFO - multicore_fifo push/pop, as used by the tuner,
+ * - seqlock - a single slot in shared RAM, guarded by a sequence counter,
+ * - SPSC ring - a single producer, single consumer ring of words in shared RAM,
+ * - doorbell - the message is written to shared RAM, and a FIFO word raises the SIO interrupt of core 1.
+ *
+ * Each mechanism is measured with messages of a 32-bit word, a result record (the flags and frequency words passed
+ * by the tuner) and a full sample frame (NUM_SAMPLES bytes). The receiver always copies the message out.
+ *
+ * Latency is measured by core 0 as a round trip, core 1 replying with a single word over the same mechanism.
+ * SysTick is private to each core, so there is no shared cycle counter to time a single direction directly.
+ * One-way latency is estimated as the round trip minus half the round trip of a 32-bit word.
+ * Jitter is reported as the spread (min/max) and standard deviation of the round trips.
+ * Throughput is measured by streaming messages without replies. Single slot mechanisms (seqlock, doorbell)
+ * wait until the previous message has been copied out, before overwriting it.
+ *
+ * The results are printed to the USB console, as "HANDOFF ..." lines.
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+
+#include "macros.h"
+
+#define BENCH_ROUNDS 1000          // Messages per measurement
+#define SYSTICK_MAX 0x00FFFFFF
+#define RING_WORDS 1024            // SPSC ring capacity, a power of two, at least FRAME_WORDS
+#define FRAME_WORDS ((NUM_SAMPLES + 3) / 4)
+
+// Messages size in words: a 32-bit word, a result record (flags and frequency), a sample frame
+static const uint16_t message_words[] = {1, 2, FRAME_WORDS};
+#define MESSAGE_SIZES (sizeof(message_words) / sizeof(message_words[0]))
+
+enum bench_mode
+{
+    BENCH_LATENCY,    // Core 1 replies to each message
+    BENCH_THROUGHPUT, // Core 1 only counts the messages
+};
+
+// Test run by core 1, set by core 0 before launching it
+static volatile uint8_t bench_mechanism;
+static volatile uint8_t bench_mode;
+static volatile uint16_t bench_words;
+
+// Messages copied out by core 1, used for flow control of the single slot mechanisms
+static volatile uint32_t received_count;
+static uint32_t sent_count;
+
+static uint32_t core0_message[FRAME_WORDS];
+static uint32_t core1_message[FRAME_WORDS];
+
+/**
+ * @brief Shared slot guarded by a sequence counter, odd while it is being written.
+ */
+struct seqlock
+{
+    volatile uint32_t sequence;
+    uint32_t data[FRAME_WORDS];
+};
+
+/**
+ * @brief Single producer, single consumer ring. Head is written by the producer only, tail by the consumer only.
+ */
+struct spsc_ring
+{
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t data[RING_WORDS];
+};
+
+static struct seqlock request_seqlock, reply_seqlock;
+static uint32_t request_sequence_seen, reply_sequence_seen;
+static struct spsc_ring request_ring, reply_ring;
+static uint32_t doorbell_slot[FRAME_WORDS];
+
+/**
+ * @brief Handoff mechanism, core 0 sends the messages, core 1 receives them and replies.
+ */
+struct handoff_mechanism
+{
+    const char *name;
+    void (*send)(const uint32_t data[], uint16_t words); // Core 0
+    void (*receive)(uint32_t data[], uint16_t words);    // Core 1, not used if the mechanism receives in the interrupt
+    void (*reply)();                                     // Core 1
+    void (*wait_reply)();                                // Core 0
+    bool interrupt;                                      // Core 1 receives in the SIO interrupt handler
+};
+
+static void wait_for_receiver()
+{
+    while (received_count != sent_count)
+        tight_loop_contents();
+}
+
+// SIO FIFO
+
+static void fifo_send(const uint32_t data[], uint16_t words)
+{
+    for (uint16_t i = 0; i < words; i++)
+    {
+        multicore_fifo_push_blocking(data[i]);
+    }
+}
+
+static void fifo_receive(uint32_t data[], uint16_t words)
+{
+    for (uint16_t i = 0; i < words; i++)
+    {
+        data[i] = multicore_fifo_pop_blocking();
+    }
+}
+
+static void fifo_reply()
+{
+    multicore_fifo_push_blocking(0);
+}
+
+static void fifo_wait_reply()
+{
+    multicore_fifo_pop_blocking();
+}
+
+// Seqlock
+
+static void seqlock_write(struct seqlock *lock, const uint32_t data[], uint16_t words)
+{
+    lock->sequence++;
+    __dmb();
+    memcpy(lock->data, data, words * sizeof(uint32_t));
+    __dmb();
+    lock->sequence++;
+}
+
+// Waits for a sequence newer than last_sequence, and returns it
+static uint32_t seqlock_read(struct seqlock *lock, uint32_t data[], uint16_t words, uint32_t last_sequence)
+{
+    while (1)
+    {
+        uint32_t sequence = lock->sequence;
+        if (sequence == last_sequence || (sequence & 1))
+            continue;
+        __dmb();
+        memcpy(data, lock->data, words * sizeof(uint32_t));
+        __dmb();
+        // Retry if the writer has started over while copying
+        if (lock->sequence == sequence)
+            return sequence;
+    }
+}
+
+static void seqlock_send(const uint32_t data[], uint16_t words)
+{
+    wait_for_receiver();
+    seqlock_write(&request_seqlock, data, words);
+    sent_count++;
+}
+
+static void seqlock_receive(uint32_t data[], uint16_t words)
+{
+    request_sequence_seen = seqlock_read(&request_seqlock, data, words, request_sequence_seen);
+}
+
+static void seqlock_reply()
+{
+    static const uint32_t ack = 0;
+    seqlock_write(&reply_seqlock, &ack, 1);
+}
+
+static void seqlock_wait_reply()
+{
+    uint32_t ack;
+    reply_sequence_seen = seqlock_read(&reply_seqlock, &ack, 1, reply_sequence_seen);
+}
+
+// SPSC ring
+
+static void ring_write(struct spsc_ring *ring, const uint32_t data[], uint16_t words)
+{
+    uint32_t head = ring->head;
+    while (head - ring->tail > (uint32_t)(RING_WORDS - words))
+        tight_loop_contents();
+    for (uint16_t i = 0; i < words; i++)
+    {
+        ring->data[(head + i) & (RING_WORDS - 1)] = data[i];
+    }
+    __dmb();
+    ring->head = head + words;
+}
+
+static void ring_read(struct spsc_ring *ring, uint32_t data[], uint16_t words)
+{
+    uint32_t tail = ring->tail;
+    while (ring->head - tail < words)
+        tight_loop_contents();
+    __dmb();
+    for (uint16_t i = 0; i < words; i++)
+    {
+        data[i] = ring->data[(tail + i) & (RING_WORDS - 1)];
+    }
+    __dmb();
+    ring->tail = tail + words;
+}
+
+static void ring_send(const uint32_t data[], uint16_t words)
+{
+    ring_write(&request_ring, data, words);
+}
+
+static void ring_receive(uint32_t data[], uint16_t words)
+{
+    ring_read(&request_ring, data, words);
+}
+
+static void ring_reply()
+{
+    static const uint32_t ack = 0;
+    ring_write(&reply_ring, &ack, 1);
+}
+
+static void ring_wait_reply()
+{
+    uint32_t ack;
+    ring_read(&reply_ring, &ack, 1);
+}
+
+// Doorbell, the FIFO word carries the message size, the handler copies the message from the slot
+
+static void doorbell_send(const uint32_t data[], uint16_t words)
+{
+    wait_for_receiver();
+    memcpy(doorbell_slot, data, words * sizeof(uint32_t));
+    __dmb();
+    sent_count++;
+    multicore_fifo_push_blocking(words);
+}
+
+static const struct handoff_mechanism mechanisms[] = {
+    {"fifo", fifo_send, fifo_receive, fifo_reply, fifo_wait_reply, false},
+    {"seqlock", seqlock_send, seqlock_receive, seqlock_reply, seqlock_wait_reply, false},
+    {"spsc_ring", ring_send, ring_receive, ring_reply, ring_wait_reply, false},
+    {"doorbell", doorbell_send, NULL, fifo_reply, fifo_wait_reply, true},
+};
+#define MECHANISM_COUNT (sizeof(mechanisms) / sizeof(mechanisms[0]))
+
+/**
+ * @brief Core 1 Doorbell Interrupt Handler Function
+ *
+ * This function copies the message announced by each doorbell word out of the shared slot.
+ */
+static void core1_doorbell_handler()
+{
+    while (multicore_fifo_rvalid())
+    {
+        uint16_t words = multicore_fifo_pop_blocking();
+        memcpy(core1_message, doorbell_slot, words * sizeof(uint32_t));
+        __dmb();
+        received_count++;
+        if (bench_mode == BENCH_LATENCY)
+            fifo_reply();
+    }
+    multicore_fifo_clear_irq();
+}
+
+/**
+ * @brief Core 1 Entry Function
+ *
+ * This function receives the messages of the test set by core 0, core 1 is reset and launched for each test.
+ */
+static void core1_entry()
+{
+    const struct handoff_mechanism *mechanism = &mechanisms[bench_mechanism];
+
+    if (mechanism->interrupt)
+    {
+        multicore_fifo_clear_irq();
+        // The vector table is shared, and keeps the handler installed by the previous launch
+        if (irq_get_exclusive_handler(SIO_IRQ_PROC1) != core1_doorbell_handler)
+            irq_set_exclusive_handler(SIO_IRQ_PROC1, core1_doorbell_handler);
+        irq_set_enabled(SIO_IRQ_PROC1, true);
+        while (1)
+            tight_loop_contents();
+    }
+
+    while (1)
+    {
+        mechanism->receive(core1_message, bench_words);
+        received_count++;
+        if (bench_mode == BENCH_LATENCY)
+            mechanism->reply();
+    }
+}
+
+/**
+ * @brief Start Test Function
+ *
+ * This function resets core 1 and the shared state, and launches core 1 receiving the given test.
+ */
+static void start_test(uint8_t mechanism, uint8_t mode, uint16_t words)
+{
+    multicore_reset_core1();
+    multicore_fifo_drain();
+
+    bench_mechanism = mechanism;
+    bench_mode = mode;
+    bench_words = words;
+    received_count = 0;
+    sent_count = 0;
+    request_seqlock.sequence = 0;
+    reply_seqlock.sequence = 0;
+    request_sequence_seen = 0;
+    reply_sequence_seen = 0;
+    request_ring.head = request_ring.tail = 0;
+    reply_ring.head = reply_ring.tail = 0;
+
+    multicore_launch_core1(core1_entry);
+}
+
+/**
+ * @brief Round Trip Statistics
+ */
+struct round_trip_stats
+{
+    uint32_t min;
+    uint32_t max;
+    uint32_t avg;
+    uint32_t std; // Standard deviation
+};
+
+/**
+ * @brief Measure Latency Function
+ *
+ * This function measures the round trips of BENCH_ROUNDS messages in system clock cycles, using SysTick of core 0.
+ */
+static struct round_trip_stats measure_latency(uint8_t mechanism, uint16_t words)
+{
+    const struct handoff_mechanism *m = &mechanisms[mechanism];
+    start_test(mechanism, BENCH_LATENCY, words);
+
+    uint64_t sum = 0, sum_of_squares = 0;
+    struct round_trip_stats stats = {UINT32_MAX, 0, 0, 0};
+    for (uint16_t round = 0; round < BENCH_ROUNDS; round++)
+    {
+        core0_message[0] = round;
+        uint32_t start = systick_hw->cvr;
+        m->send(core0_message, words);
+        m->wait_reply();
+        uint32_t cycles = (start - systick_hw->cvr) & SYSTICK_MAX; // SysTick counts down
+
+        sum += cycles;
+        sum_of_squares += (uint64_t)cycles * cycles;
+        if (cycles < stats.min)
+            stats.min = cycles;
+        if (cycles > stats.max)
+            stats.max = cycles;
+    }
+
+    stats.avg = sum / BENCH_ROUNDS;
+    uint64_t variance = sum_of_squares / BENCH_ROUNDS - (uint64_t)stats.avg * stats.avg;
+    // Integer square root, the variance fits 32 bits for any round trip below SysTick range
+    while ((uint64_t)stats.std * stats.std < variance)
+        stats.std++;
+    return stats;
+}
+
+/**
+ * @brief Measure Throughput Function
+ *
+ * This function streams BENCH_ROUNDS messages without replies.
+ *
+ * @return The elapsed time, us.
+ */
+static uint32_t measure_throughput(uint8_t mechanism, uint16_t words)
+{
+    const struct handoff_mechanism *m = &mechanisms[mechanism];
+    start_test(mechanism, BENCH_THROUGHPUT, words);
+
+    uint64_t start = time_us_64();
+    for (uint16_t round = 0; round < BENCH_ROUNDS; round++)
+    {
+        core0_message[0] = round;
+        m->send(core0_message, words);
+    }
+    while (received_count != BENCH_ROUNDS)
+        tight_loop_contents();
+    return time_us_64() - start;
+}
+
+int main()
+{
+    stdio_init_all();
+
+    // SysTick of core 0 as a free running cycle counter
+    systick_hw->rvr = SYSTICK_MAX;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0b101; // Enable, clocked by the processor clock, no interrupt
+
+    // Give the USB console time to connect
+    sleep_ms(3000);
+
+    while (1)
+    {
+        printf("HANDOFF clk_sys: %lu Hz, rounds: %d\n", (unsigned long)clock_get_hz(clk_sys), BENCH_ROUNDS);
+        printf("HANDOFF %-10s %6s %8s %8s %8s %8s %9s %10s %10s\n",
+               "mechanism", "bytes", "rtt_min", "rtt_avg", "rtt_max", "rtt_std", "one_way", "msg/s", "KB/s");
+
+        for (uint8_t mechanism = 0; mechanism < MECHANISM_COUNT; mechanism++)
+        {
+            uint32_t word_round_trip = 0;
+            for (uint8_t size = 0; size < MESSAGE_SIZES; size++)
+            {
+                uint16_t words = message_words[size];
+                struct round_trip_stats latency = measure_latency(mechanism, words);
+                if (size == 0)
+                    word_round_trip = latency.avg;
+                uint32_t elapsed_us = measure_throughput(mechanism, words);
+
+                // All latencies in cycles
+                printf("HANDOFF %-10s %6u %8lu %8lu %8lu %8lu %9lu %10lu %10lu\n",
+                       mechanisms[mechanism].name,
+                       (unsigned)(words * sizeof(uint32_t)),
+                       (unsigned long)latency.min,
+                       (unsigned long)latency.avg,
+                       (unsigned long)latency.max,
+                       (unsigned long)latency.std,
+                       (unsigned long)(latency.avg - word_round_trip / 2),
+                       (unsigned long)((uint64_t)BENCH_ROUNDS * 1000000 / elapsed_us),
+                       (unsigned long)((uint64_t)BENCH_ROUNDS * words * sizeof(uint32_t) * 1000000 / 1024 / elapsed_us));
+            }
+        }
+        multicore_reset_core1();
+        sleep_ms(10000);
+    }
+}
@@ -0,0 +1,71 @@
+#include "lag_priors.h"
+
+static struct lag_priors lag_priors;
+static uint16_t recorded_since_save = 0;
+
+// Selects the LAG_PRIOR_CANDIDATES most populated buckets as the prior lags of calculate_freq
+static void update_prior_lags()
+{
+    prior_lag_count = 0;
+    for (uint8_t candidate = 0; candidate < LAG_PRIOR_CANDIDATES; candidate++)
+    {
+        uint16_t best_bucket = 0;
+        uint16_t best_count = 0;
+        for (uint16_t bucket = 0; bucket < LAG_PRIOR_BUCKETS; bucket++)
+        {
+            bool selected = false;
+            for (uint8_t i = 0; i < prior_lag_count; i++)
+            {
+                if (prior_lags[i] == bucket * LAG_PRIOR_BUCKET_WIDTH)
+                    selected = true;
+            }
+            if (!selected && lag_priors.counts[bucket] > best_count)
+            {
+                best_bucket = bucket;
+                best_count = lag_priors.counts[bucket];
+            }
+        }
+        if (best_count < LAG_PRIOR_MIN_COUNT)
+            return;
+        prior_lags[prior_lag_count++] = best_bucket * LAG_PRIOR_BUCKET_WIDTH;
+    }
+}
+
+void record_lag_prior(float period)
+{
+    uint16_t bucket = period / LAG_PRIOR_BUCKET_WIDTH;
+    if (bucket >= LAG_PRIOR_BUCKETS)
+        return;
+
+    if (lag_priors.counts[bucket] == UINT16_MAX)
+    {
+        for (uint16_t i = 0; i < LAG_PRIOR_BUCKETS; i++)
+        {
+            lag_priors.counts[i] /= 2;
+        }
+    }
+    lag_priors.counts[bucket]++;
+    recorded_since_save++;
+
+    update_prior_lags();
+}
+
+bool lag_priors_save_due()
+{
+    return recorded_since_save >= LAG_PRIOR_SAVE_INTERVAL;
+}
+
+bool load_lag_priors()
+{
+    if (!flash_storage_load(LAG_PRIORS_STORAGE_SECTOR, LAG_PRIORS_VERSION, &lag_priors, sizeof(lag_priors)))
+        return false;
+
+    update_prior_lags();
+    return true;
+}
+
+void store_lag_priors()
+{
+    flash_storage_store(LAG_PRIORS_STORAGE_SECTOR, LAG_PRIORS_VERSION, &lag_priors, sizeof(lag_priors));
+    recorded_since_save = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef LAG_PRIORS_H
+#define LAG_PRIORS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "macros.h"
+#include "freq_analysis.h"
+#include "flash_storage.h"
+
+#define LAG_PRIORS_STORAGE_SECTOR 1
+#define LAG_PRIORS_VERSION 1
+#define LAG_PRIOR_BUCKETS ((SHIFT_LIMIT + LAG_PRIOR_BUCKET_WIDTH - 1) / LAG_PRIOR_BUCKET_WIDTH)
+
+/**
+ * @brief Histogram of the periods detected with confidence, learned in the field.
+ *
+ * Each bucket covers LAG_PRIOR_BUCKET_WIDTH consecutive shifts. When a bucket saturates, all the counts are halved,
+ * so the histogram follows the tunings actually in use.
+ */
+struct lag_priors
+{
+    uint16_t counts[LAG_PRIOR_BUCKETS];
+};
+
+/**
+ * @brief Records a period detected with confidence, and updates the prior lags of calculate_freq.
+ *
+ * @param period The detected period, in samples.
+ */
+void record_lag_prior(float period);
+
+/**
+ * @brief Checks whether enough periods have been recorded since the histogram was last stored.
+ *
+ * @return true if the histogram should be stored.
+ */
+bool lag_priors_save_due();
+
+/**
+ * @brief Loads the histogram stored in flash, and updates the prior lags of calculate_freq.
+ *
+ * @return true if a valid histogram has been found.
+ */
+bool load_lag_priors();
+
+/**
+ * @brief Stores the histogram in flash.
+ *
+ * Must not be called when the other core may be executing from flash.
+ */
+void store_lag_priors();
+
+#endif
@@ -8,8 +8,78 @@
 #define PEAK_SEARCH_RANGE 15        // The width of peak search. It's assumed that peaks should not be separated by less than 2*PEAK_SEARCH_RANGE samples.
 #define PEAK_TRACKING_LIMIT 10      // Maximum peak count to track
 #define INTERFERENCE_THRESHOLD 3000 // Peaks of value higher that INTERFERENCE_THRESHOLD are ignored, thus if interference exceeds this value, its calculation can be aborted
+#define SUBSAMPLED_INTERFERENCE 0   // Set to 1 to screen the shifts with an interference estimate from a subset of the elements, see estimate_interference_pwr.
+#define SUBSAMPLE_STRIDE 8          // One element per SUBSAMPLE_STRIDE is compared by the estimate.
+#define SUBSAMPLE_CONFIDENCE 3.0f   // Confidence bound of the estimate, in standard errors. Shifts whose estimate exceeds the threshold by more are not calculated exactly.
+#define SUBSAMPLE_ABORT_RATIO 2     // The estimate is aborted when it exceeds the threshold this many times.
+#define SUBSAMPLE_MIN_STRATA 16     // Shifts with fewer strata are calculated exactly.
+#define SUBSAMPLE_AUDIT_INTERVAL 64 // One per this many screened shifts is calculated exactly, to count the shifts missed by the screening.
+#define ANALYSIS_SLICE_SHIFTS 32    // Shifts evaluated by calculate_freq between the calls of analysis_yield.
 #define TUNE_PRECISION 0.7          // Tuning precision
 #define DEFAULT_VAL 100
+#define SMA_USE_INTERP 1            // Set to 1 to keep the SMA running sum in the hardware interpolator, 0 to use the portable smooth_samples.
+#define SMOOTH_IN_PLACE 1           // Set to 1 to capture into two alternating buffers, and smooth and analyze each one in place.
+#define FREQ_ENGINE ENGINE_INTERFERENCE // Frequency estimation engine, see freq_analysis.h.
+#define NSDF_THRESHOLD 0.5          // Signals whose highest NSDF key maximum does not exceed this value are treated as unpitched.
+#define NSDF_K 0.9                  // The first NSDF key maximum reaching this fraction of the highest one is selected as the period.
+#define REFERENCE_TOLERANCE 10      // Reference engine candidates are minima within this percentage of the range between the lowest and the mean interference.
+#define REFERENCE_HARMONICS 3       // Reference engine candidates are confirmed by their multiples up to this one.
+#define WAVELET_MAX_FREQ 1500       // Highest frequency expected by the wavelet engine, Hz. Sets the min distance of the extrema and the mode tolerance.
+#define WAVELET_LEVELS 6            // Max number of Haar decimations performed by the wavelet engine.
+#define WAVELET_NEIGHBOURS 2        // The distances from each extremum to this many following ones vote for the period.
+#define WAVELET_MAX_EXTREMA 64      // Extrema of each polarity tracked per decimation level.
+#define WAVELET_SEED 0              // Set to 1 to evaluate the period found by the wavelet engine first in calculate_freq, as a lag prior...
+#define WAVELET_SEED_VOTES 4        // ...if it has at least this many votes.
+#define WAVELET_CONFIDENT_VOTES 2   // Min votes of the period for a confident result of the wavelet engine (one extremum of each polarity)...
+#define WAVELET_MAX_EXTREMA_EXCESS 125 // ...and max number of extrema of its level, in percent of two per period (noise crowds them).
+#define PRECONDITIONING PRECONDITIONING_NONE // Preconditioning applied while smoothing, see freq_analysis.h.
+#define CLIP_RATIO 20               // Preconditioning clip level, in percent of the peak amplitude of the previous frame.
+#define THREE_LEVEL_AMPLITUDE 32    // Amplitude of the PRECONDITIONING_THREE_LEVEL output.
+#define DUAL_WINDOW 1               // Set to 1 to publish a provisional note from the beginning of each capture, before the full analysis.
+#define PROVISIONAL_WINDOW_DIVIDER 2 // The provisional window and its shift limit are those of the active profile divided by this value.
+#define PROVISIONAL_THRESHOLD_DIVIDER 4 // Interference threshold of the provisional analysis is divided by this value, as shorter overlaps let more lags through.
+#define HARMONIC_LOCK 1             // Set to 1 to analyze low notes from the period of their dominant harmonic (calculate_freq_harmonic_locked).
+#define HARMONIC_LOCK_MAX_FREQ 80.0 // Harmonic locked analysis is used by the profiles with the lowest frequency below this value, Hz.
+#define HARMONIC_LOCK_WINDOW_DIVIDER 2 // The harmonic period is searched in the window and shift limit divided by this value.
+#define HARMONIC_LOCK_THRESHOLD_DIVIDER 4 // Interference threshold of the short window is divided by this value.
+#define HARMONIC_LOCK_MAX_HARMONIC 3 // Highest harmonic number tested.
+#define HARMONIC_LOCK_MAX_RESIDUE 30 // A multiple of the period is accepted as the fundamental if the interference per element stays below this percentage of the mean deviation from DC bias.
+#define SHADOW_MODE 0               // Set to 1 to analyze a sample of the frames also with SHADOW_ENGINE on core 1, and report its agreement with the displayed results.
+#define SHADOW_ENGINE ENGINE_REFERENCE // Frequency estimation engine evaluated in the shadow mode, see freq_analysis.h.
+#define SHADOW_LOG_ALL 0            // Set to 1 to print every shadow frame, not only the disagreements, e.g. to label captured frames with ENGINE_REFERENCE.
+#define SHADOW_INTERVAL 8           // Every SHADOW_INTERVAL-th analyzed frame is submitted to the shadow engine (skipped if it is still busy).
+#define SHADOW_AGREEMENT_CENTS 10   // Results of both engines closer than this agree, ones closer to a multiple of an octave are octave errors.
+#define SHADOW_STACK_SIZE 8192      // Core 1 stack size in the shadow mode, the engines keep their working arrays on the stack.
+#define AUTO_PROFILE 1              // Set to 1 to narrow the analysis to the tightest instrument profile matching the notes played.
+#define DEFAULT_PROFILE PROFILE_BASS // Profile used at power-up, and permanently if AUTO_PROFILE is 0 (see profile.h).
+#define AUTO_PROFILE_NOTES 8        // Number of confident notes observed before narrowing the profile.
+#define MIN_CONFIDENT_PEAKS 2       // Minimum peak count for a result to be considered confident.
+#define AUTO_PROFILE_MISSES 3       // Number of consecutive frames without any peak, after which the widest profile is restored.
+#define LAG_PRIOR_BUCKET_WIDTH 8    // Width of the buckets of the detected periods histogram, in samples.
+#define LAG_PRIOR_CANDIDATES 6      // Number of the most populated buckets evaluated before the other shifts.
+#define LAG_PRIOR_MIN_COUNT 16      // Buckets populated less are not used as priors.
+#define LAG_PRIOR_BOUND_RATIO 2     // The threshold is lowered to LAG_PRIOR_BOUND_RATIO times the best interference found among the priors...
+#define LAG_PRIOR_MIN_BOUND_DIVIDER 4 // ...but not below INTERFERENCE_THRESHOLD / LAG_PRIOR_MIN_BOUND_DIVIDER.
+#define LAG_PRIOR_SAVE_INTERVAL 5000 // Number of periods recorded between storing the histogram in flash.
+#define PREDICTIVE_DISPLAY 1        // Set to 1 to refresh the display between the results, with the frequency extrapolated by the pitch tracker.
+#define DISPLAY_REFRESH_US 10000    // Display refresh period when PREDICTIVE_DISPLAY is enabled.
+#define DISPLAY_REFRESH_IRQ 1       // Set to 1 to refresh the display from a core 1 timer interrupt, preempting the shadow analysis, 0 to poll in the core 1 loop.
+#define SINGLE_CORE 0               // Set to 1 to run on core 0 only, refreshing the display and handling the results between the analysis slices.
+#define TRACKER_BETA_SHIFT 2        // Pitch tracker velocity gain is 1 / 2^TRACKER_BETA_SHIFT.
+#define TRACKER_MAX_EXTRAPOLATION_US 100000 // The tracker holds the frequency if no result arrives for longer than that.
+#define CALIBRATION_FRAMES 16       // Number of frames captured at the first power-up (with no input) to measure DC bias and noise floor.
+#define CALIBRATION_MAX_NOISE 4     // Calibration is rejected if the average deviation from DC bias exceeds this value (the input was not quiet).
+#define NOISE_GATE_RATIO 4          // Frames of power below NOISE_GATE_RATIO * noise floor are not analyzed.
+#define INTERFERENCE_NOISE_RATIO 2  // Interference threshold is raised to at least INTERFERENCE_NOISE_RATIO * noise floor.
+#define FORCE_CALIBRATION 0         // Set to 1 to ignore the calibration stored in flash, and calibrate at every power-up.
+#define STATS_REPORT_INTERVAL 200   // Number of analyzed frames between printing the acquisition/analysis counters to the console.
+#define SOAK_MONITOR 0              // Set to 1 to report the frame time percentiles, missed deadlines and stack high-water mark of each report window, and flag upward trends.
+#define SOAK_TREND_WINDOWS 8        // A line is fitted to the mean frame time of this many last report windows...
+#define SOAK_TREND_PERCENT 10       // ...and a rise across them by more than this percentage of the mean is reported as a regression.
+#define METRICS_ENDPOINT 1          // Set to 1 to print the counters in the Prometheus text format when METRICS_REQUEST is received on the console.
+#define METRICS_REQUEST 'm'         // Character requesting the metrics, e.g. sent by a host script scraping the serial port.
+#define PITCH_TRACK 0               // Set to 1 to print the results to the console as packed pitch track blocks (see pitch_track.h).
+#define PITCH_TRACK_BLOCK_RECORDS 64 // Number of results per pitch track block.
 
 #define SEGMENT_A_PIN  9            // Segment A wired to GP9
 #define SEGMENT_B_PIN  8
@@ -72,6 +142,8 @@
 #define ADC_CHAN 0          // ADC mux value (0 for input 26)
 #define ADC_PIN 26          // ADC input pin
 #define FS 44000            // Sampling freq. Increasing is unlikely to improve tuner operation. 44000 is probably still an overkill.
+#define ADC_FS FS           // ADC sampling freq. If different from FS, samples are resampled to FS while smoothing. 48000 gives an integer ADC clock divider.
+                            // The SMA runs at ADC_FS, so its -3 dB point (about 0.443 * ADC_FS / (SMA_WIDTH + 1), 928 Hz at 44000) moves with it.
 #define ADCCLK 48000000.0   // Internal ADC clock freq, not adjustable
 
 #endif
\ No newline at end of file
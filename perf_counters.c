@@ -0,0 +1,35 @@
+#include "perf_counters.h"
+
+#define SYSTICK_MAX 0x00FFFFFF
+
+void init_perf_counters()
+{
+    systick_hw->rvr = SYSTICK_MAX;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0b101; // Enable, clocked by the processor clock, no interrupt
+}
+
+void perf_begin(struct perf_snapshot *snapshot)
+{
+    snapshot->xip_hits = xip_ctrl_hw->ctr_hit;
+    snapshot->xip_accesses = xip_ctrl_hw->ctr_acc;
+    snapshot->time_us = time_us_32();
+    snapshot->systick = systick_hw->cvr;
+}
+
+void perf_end(struct perf_snapshot *snapshot, enum perf_stage stage)
+{
+    uint32_t systick = systick_hw->cvr;
+    uint32_t elapsed_us = time_us_32() - snapshot->time_us;
+    struct stage_stats *stage_stats = &stats.stages[stage];
+
+    // SysTick wraps every 2^24 cycles, longer stages are measured with the microsecond timer
+    if ((uint64_t)elapsed_us * (clock_get_hz(clk_sys) / 1000000) < SYSTICK_MAX / 2)
+        stage_stats->cycles += (snapshot->systick - systick) & SYSTICK_MAX;
+    else
+        stage_stats->cycles += (uint64_t)elapsed_us * (clock_get_hz(clk_sys) / 1000000);
+
+    stage_stats->xip_hits += xip_ctrl_hw->ctr_hit - snapshot->xip_hits;
+    stage_stats->xip_accesses += xip_ctrl_hw->ctr_acc - snapshot->xip_accesses;
+    stage_stats->count++;
+}
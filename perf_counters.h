@@ -0,0 +1,44 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "stats.h"
+
+/**
+ * @brief Snapshot of the counters taken at the beginning of a stage.
+ */
+struct perf_snapshot
+{
+    uint32_t systick;     // SysTick counts down, one tick per system clock cycle
+    uint32_t time_us;     // Used instead of SysTick for stages longer than its 24-bit range
+    uint32_t xip_hits;    // XIP cache hits (code and constants fetched from flash by either core)
+    uint32_t xip_accesses;
+};
+
+/**
+ * @brief Starts the SysTick of the calling core as a free running cycle counter.
+ *
+ * The XIP cache counters are shared by both cores and need no initialization.
+ */
+void init_perf_counters();
+
+/**
+ * @brief Takes a snapshot of the counters at the beginning of a stage.
+ *
+ * @param snapshot Pointer to the snapshot to fill.
+ */
+void perf_begin(struct perf_snapshot *snapshot);
+
+/**
+ * @brief Accumulates the counters elapsed since the snapshot in the stats of the given stage.
+ *
+ * @param snapshot Pointer to the snapshot taken at the beginning of the stage.
+ * @param stage The stage to account the counters to.
+ */
+void perf_end(struct perf_snapshot *snapshot, enum perf_stage stage);
+
+#endif
@@ -0,0 +1,241 @@
+#include "pitch_track.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Bit position of the next packed value
+struct bit_cursor
+{
+    uint8_t *data;
+    uint32_t bit;
+};
+
+static struct pitch_track_record block_records[PITCH_TRACK_BLOCK_RECORDS];
+static uint16_t block_record_count = 0;
+static uint8_t block_buffer[sizeof(struct pitch_track_block_header) + PITCH_TRACK_MAX_PAYLOAD];
+
+static void print_block(const uint8_t block[], uint16_t size)
+{
+    printf("TRACK ");
+    for (uint16_t i = 0; i < size; i++)
+    {
+        printf("%02x", block[i]);
+    }
+    printf("\n");
+}
+
+void (*pitch_track_output)(const uint8_t block[], uint16_t size) = print_block;
+
+int32_t pitch_track_pitch(float frequency)
+{
+    return lroundf(12000 * log2f(frequency / 440.0f));
+}
+
+// Number of bits needed to store values from 0 to range
+static uint8_t bit_width(uint32_t range)
+{
+    uint8_t width = 0;
+    while (range)
+    {
+        width++;
+        range >>= 1;
+    }
+    return width;
+}
+
+static void write_bits(struct bit_cursor *cursor, uint32_t value, uint8_t width)
+{
+    for (uint8_t i = 0; i < width; i++, cursor->bit++)
+    {
+        if (value >> i & 1)
+            cursor->data[cursor->bit / 8] |= 1 << cursor->bit % 8;
+    }
+}
+
+static uint32_t read_bits(struct bit_cursor *cursor, uint8_t width)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < width; i++, cursor->bit++)
+    {
+        if (cursor->data[cursor->bit / 8] >> cursor->bit % 8 & 1)
+            value |= 1u << i;
+    }
+    return value;
+}
+
+// Value of a record stored in the column, before subtracting the block minimum
+static uint32_t column_value(const struct pitch_track_record *record, const struct pitch_track_record *previous,
+                             enum pitch_track_column column)
+{
+    switch (column)
+    {
+    case PITCH_TRACK_TIME:
+        return previous ? record->time_ms - previous->time_ms : 0;
+    case PITCH_TRACK_PITCH:
+        return record->pitch;
+    case PITCH_TRACK_CONFIDENCE:
+        return record->confidence;
+    default:
+        return record->cost;
+    }
+}
+
+static uint32_t column_min(const struct pitch_track_block_header *header, enum pitch_track_column column)
+{
+    switch (column)
+    {
+    case PITCH_TRACK_TIME:
+        return 0;
+    case PITCH_TRACK_PITCH:
+        return header->min_pitch;
+    case PITCH_TRACK_CONFIDENCE:
+        return header->min_confidence;
+    default:
+        return header->min_cost;
+    }
+}
+
+static uint16_t column_bytes(const struct pitch_track_block_header *header, enum pitch_track_column column)
+{
+    return ((uint32_t)header->record_count * header->widths[column] + 7) / 8;
+}
+
+// Encodes the collected records into block_buffer, returns the size of the block
+static uint16_t encode_block()
+{
+    memset(block_buffer, 0, sizeof(block_buffer));
+    struct pitch_track_block_header *header = (struct pitch_track_block_header *)block_buffer;
+    header->magic = PITCH_TRACK_MAGIC;
+    header->record_count = block_record_count;
+    header->first_time_ms = block_records[0].time_ms;
+    header->last_time_ms = block_records[block_record_count - 1].time_ms;
+    header->min_pitch = header->max_pitch = block_records[0].pitch;
+    header->min_confidence = header->max_confidence = block_records[0].confidence;
+    header->min_cost = header->max_cost = block_records[0].cost;
+    uint32_t max_time_delta = 0;
+    for (uint16_t i = 0; i < block_record_count; i++)
+    {
+        const struct pitch_track_record *record = &block_records[i];
+        if (i > 0 && record->time_ms - block_records[i - 1].time_ms > max_time_delta)
+            max_time_delta = record->time_ms - block_records[i - 1].time_ms;
+        if (record->pitch < header->min_pitch)
+            header->min_pitch = record->pitch;
+        if (record->pitch > header->max_pitch)
+            header->max_pitch = record->pitch;
+        if (record->confidence < header->min_confidence)
+            header->min_confidence = record->confidence;
+        if (record->confidence > header->max_confidence)
+            header->max_confidence = record->confidence;
+        if (record->cost < header->min_cost)
+            header->min_cost = record->cost;
+        if (record->cost > header->max_cost)
+            header->max_cost = record->cost;
+        header->total_cost += record->cost;
+    }
+    header->widths[PITCH_TRACK_TIME] = bit_width(max_time_delta);
+    header->widths[PITCH_TRACK_PITCH] = bit_width((uint32_t)header->max_pitch - (uint32_t)header->min_pitch);
+    header->widths[PITCH_TRACK_CONFIDENCE] = bit_width(header->max_confidence - header->min_confidence);
+    header->widths[PITCH_TRACK_COST] = bit_width(header->max_cost - header->min_cost);
+
+    struct bit_cursor cursor = {block_buffer + sizeof(struct pitch_track_block_header), 0};
+    for (uint8_t column = 0; column < PITCH_TRACK_COLUMNS; column++)
+    {
+        for (uint16_t i = 0; i < block_record_count; i++)
+        {
+            uint32_t value = column_value(&block_records[i], i > 0 ? &block_records[i - 1] : NULL, column);
+            write_bits(&cursor, value - column_min(header, column), header->widths[column]);
+        }
+        cursor.bit = (cursor.bit + 7) / 8 * 8;
+    }
+    header->payload_bytes = (cursor.bit / 8 + 3) / 4 * 4;
+    return sizeof(struct pitch_track_block_header) + header->payload_bytes;
+}
+
+void pitch_track_add(const struct pitch_track_record *record)
+{
+    block_records[block_record_count++] = *record;
+    if (block_record_count == PITCH_TRACK_BLOCK_RECORDS)
+        pitch_track_flush();
+}
+
+void pitch_track_flush()
+{
+    if (block_record_count == 0)
+        return;
+    pitch_track_output(block_buffer, encode_block());
+    block_record_count = 0;
+}
+
+const struct pitch_track_block_header *pitch_track_next_block(const uint8_t *track, uint32_t size, uint32_t *offset)
+{
+    if (*offset + sizeof(struct pitch_track_block_header) > size)
+        return NULL;
+    const struct pitch_track_block_header *header = (const struct pitch_track_block_header *)(track + *offset);
+    if (header->magic != PITCH_TRACK_MAGIC || header->record_count > PITCH_TRACK_BLOCK_RECORDS ||
+        *offset + sizeof(struct pitch_track_block_header) + header->payload_bytes > size)
+        return NULL;
+    *offset += sizeof(struct pitch_track_block_header) + header->payload_bytes;
+    return header;
+}
+
+void pitch_track_decode_column(const struct pitch_track_block_header *header, enum pitch_track_column column, int64_t values[])
+{
+    // The offset of the column follows from the widths of the preceding ones
+    struct bit_cursor cursor = {(uint8_t *)(header + 1), 0};
+    for (uint8_t i = 0; i < column; i++)
+    {
+        cursor.bit += column_bytes(header, i) * 8;
+    }
+
+    int64_t time = header->first_time_ms;
+    for (uint16_t i = 0; i < header->record_count; i++)
+    {
+        uint32_t value = read_bits(&cursor, header->widths[column]) + column_min(header, column);
+        if (column == PITCH_TRACK_TIME)
+            values[i] = time += value;
+        else if (column == PITCH_TRACK_PITCH)
+            values[i] = (int32_t)value;
+        else
+            values[i] = value;
+    }
+}
+
+void pitch_track_summarize(const uint8_t *track, uint32_t size, uint32_t from_ms, uint32_t to_ms,
+                           struct pitch_track_summary *summary)
+{
+    *summary = (struct pitch_track_summary){0, INT32_MAX, INT32_MIN, 0};
+    uint32_t offset = 0;
+    const struct pitch_track_block_header *header;
+    while ((header = pitch_track_next_block(track, size, &offset)))
+    {
+        if (header->last_time_ms < from_ms || header->first_time_ms > to_ms)
+            continue;
+
+        if (header->first_time_ms >= from_ms && header->last_time_ms <= to_ms)
+        {
+            summary->record_count += header->record_count;
+            summary->total_cost += header->total_cost;
+            if (header->min_pitch < summary->min_pitch)
+                summary->min_pitch = header->min_pitch;
+            if (header->max_pitch > summary->max_pitch)
+                summary->max_pitch = header->max_pitch;
+            continue;
+        }
+
+        int64_t times[PITCH_TRACK_BLOCK_RECORDS], pitches[PITCH_TRACK_BLOCK_RECORDS], costs[PITCH_TRACK_BLOCK_RECORDS];
+        pitch_track_decode_column(header, PITCH_TRACK_TIME, times);
+        pitch_track_decode_column(header, PITCH_TRACK_PITCH, pitches);
+        pitch_track_decode_column(header, PITCH_TRACK_COST, costs);
+        for (uint16_t i = 0; i < header->record_count; i++)
+        {
+            if (times[i] < from_ms || times[i] > to_ms)
+                continue;
+            summary->record_count++;
+            summary->total_cost += costs[i];
+            if (pitches[i] < summary->min_pitch)
+                summary->min_pitch = pitches[i];
+            if (pitches[i] > summary->max_pitch)
+                summary->max_pitch = pitches[i];
+        }
+    }
+}
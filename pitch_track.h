@@ -0,0 +1,136 @@
+#ifndef PITCH_TRACK_H
+#define PITCH_TRACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "macros.h"
+
+// The track is a sequence of blocks, each one a header followed by the packed columns.
+// Multi-byte fields are little-endian, as on the device.
+#define PITCH_TRACK_MAGIC 0x4B525450 // "PTRK"
+// Each column is rounded up to whole bytes, and the payload to whole words, so the headers stay aligned
+#define PITCH_TRACK_MAX_PAYLOAD (PITCH_TRACK_BLOCK_RECORDS * (32 + 32 + 8 + 32) / 8 + PITCH_TRACK_COLUMNS + 3)
+
+// Columns, packed one after another, each one starting at a byte boundary
+enum pitch_track_column
+{
+    PITCH_TRACK_TIME,       // Time elapsed since the previous record (0 for the first one), ms
+    PITCH_TRACK_PITCH,      // Pitch, in 0.1 cent from A4, relative to the block minimum
+    PITCH_TRACK_CONFIDENCE, // Peak count of the result, relative to the block minimum
+    PITCH_TRACK_COST,       // Analysis cost, cycles, relative to the block minimum
+    PITCH_TRACK_COLUMNS
+};
+
+/**
+ * @brief A single analysis result.
+ */
+struct pitch_track_record
+{
+    uint32_t time_ms;   // Time of the result, ms since power-up
+    int32_t pitch;      // Pitch, in 0.1 cent from A4, the note and its deviation are derived from it
+    uint8_t confidence; // Peak count of the result
+    uint32_t cost;      // Analysis cost, cycles
+};
+
+/**
+ * @brief Header of a block, serving as its index entry.
+ *
+ * The time range lets a reader seek by time, and the per-column ranges and the total cost let it aggregate
+ * over whole blocks without decoding any column. The block ends payload_bytes after the header.
+ */
+struct pitch_track_block_header
+{
+    uint32_t magic;         // PITCH_TRACK_MAGIC
+    uint32_t first_time_ms; // Time of the first record
+    uint32_t last_time_ms;  // Time of the last record
+    int32_t min_pitch;
+    int32_t max_pitch;
+    uint32_t min_cost;
+    uint32_t max_cost;
+    uint32_t total_cost;    // Sum of the analysis costs of all the records
+    uint16_t record_count;
+    uint16_t payload_bytes; // Size of the packed columns following the header
+    uint8_t min_confidence;
+    uint8_t max_confidence;
+    uint8_t widths[PITCH_TRACK_COLUMNS]; // Bits per packed value of each column
+};
+
+/**
+ * @brief Aggregates of the records within a time range.
+ */
+struct pitch_track_summary
+{
+    uint32_t record_count;
+    int32_t min_pitch;
+    int32_t max_pitch;
+    uint64_t total_cost;
+};
+
+/**
+ * @brief Receives each encoded block, prints it to the console as a line starting with "TRACK ", followed by the block in hex.
+ *
+ * Concatenating the decoded lines gives the track. May be replaced, e.g. to collect the blocks in memory.
+ */
+extern void (*pitch_track_output)(const uint8_t block[], uint16_t size);
+
+/**
+ * @brief Converts a frequency to the pitch stored in the track.
+ *
+ * @param frequency The frequency, Hz.
+ *
+ * @return The pitch, in 0.1 cent from A4.
+ */
+int32_t pitch_track_pitch(float frequency);
+
+/**
+ * @brief Adds a result to the block being collected, and outputs the block once PITCH_TRACK_BLOCK_RECORDS are collected.
+ *
+ * @param record Pointer to the result.
+ */
+void pitch_track_add(const struct pitch_track_record *record);
+
+/**
+ * @brief Outputs the results collected so far as a shorter block, e.g. when the recording ends.
+ *
+ * Nothing is output if no result has been collected since the previous block.
+ */
+void pitch_track_flush();
+
+/**
+ * @brief Finds the block starting at the given offset of the track.
+ *
+ * @param track Pointer to the track.
+ * @param size Size of the track in bytes.
+ * @param offset Offset of the block. Advanced to the next block, so the blocks can be visited without decoding them.
+ *
+ * @return Pointer to the block header, or NULL if there is no valid block at the offset
+ *         (or it holds more than PITCH_TRACK_BLOCK_RECORDS records).
+ */
+const struct pitch_track_block_header *pitch_track_next_block(const uint8_t *track, uint32_t size, uint32_t *offset);
+
+/**
+ * @brief Decodes a single column of a block, without decoding the others.
+ *
+ * @param header Pointer to the block header, followed by its payload.
+ * @param column The column to decode.
+ * @param values Pointer to an array receiving record_count values. Times are absolute, the other values are restored
+ *               by adding the block minimum.
+ */
+void pitch_track_decode_column(const struct pitch_track_block_header *header, enum pitch_track_column column, int64_t values[]);
+
+/**
+ * @brief Aggregates the records of the track within a time range.
+ *
+ * Blocks entirely within the range are aggregated from their headers. Only the blocks crossing the boundaries of the range
+ * are decoded, and only the needed columns.
+ *
+ * @param track Pointer to the track.
+ * @param size Size of the track in bytes.
+ * @param from_ms The beginning of the range, inclusive.
+ * @param to_ms The end of the range, inclusive.
+ * @param summary Pointer to the summary to fill.
+ */
+void pitch_track_summarize(const uint8_t *track, uint32_t size, uint32_t from_ms, uint32_t to_ms,
+                           struct pitch_track_summary *summary);
+
+#endif
@@ -0,0 +1,38 @@
+#include "pitch_tracker.h"
+
+// Change of frequency over the given time, mHz
+static int32_t frequency_change(int32_t velocity, uint32_t elapsed_us)
+{
+    if (elapsed_us > TRACKER_MAX_EXTRAPOLATION_US)
+        elapsed_us = TRACKER_MAX_EXTRAPOLATION_US;
+    // Milliseconds keep the product within 32 bits
+    return velocity * (int32_t)(elapsed_us / 1000) / 1000;
+}
+
+void update_pitch_tracker(struct pitch_tracker *tracker, float frequency, uint32_t timestamp)
+{
+    int32_t measured = frequency * 1000;
+    uint32_t elapsed_us = timestamp - tracker->timestamp;
+    int32_t elapsed_ms = elapsed_us / 1000;
+
+    int32_t predicted = tracker->frequency + frequency_change(tracker->velocity, elapsed_us);
+    int32_t error = measured - predicted;
+
+    // Quarter tone, the same ratio as the note ranges
+    int32_t max_error = measured / 34;
+
+    if (tracker->frequency == 0 || elapsed_ms == 0 || elapsed_us > TRACKER_MAX_EXTRAPOLATION_US || abs(error) > max_error)
+        tracker->velocity = 0;
+    else
+        tracker->velocity += (error * 1000 / elapsed_ms) >> TRACKER_BETA_SHIFT;
+
+    tracker->frequency = measured;
+    tracker->timestamp = timestamp;
+}
+
+float predict_pitch(struct pitch_tracker *tracker, uint32_t timestamp)
+{
+    if (tracker->frequency == 0)
+        return 0;
+    return (tracker->frequency + frequency_change(tracker->velocity, timestamp - tracker->timestamp)) / 1000.0f;
+}
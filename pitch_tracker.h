@@ -0,0 +1,45 @@
+#ifndef PITCH_TRACKER_H
+#define PITCH_TRACKER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "macros.h"
+
+/**
+ * @brief State of the alpha-beta pitch tracker.
+ *
+ * The frequency is kept in mHz, its rate of change in mHz per second, so the tracker only needs integer arithmetic.
+ */
+struct pitch_tracker
+{
+    int32_t frequency;   // Frequency at the last measurement, mHz (0 if there was none yet)
+    int32_t velocity;    // Rate of change of the frequency, mHz/s
+    uint32_t timestamp;  // Time of the last measurement, us
+};
+
+/**
+ * @brief Updates the tracker with a new measurement.
+ *
+ * The tracked frequency snaps to the measurement (alpha = 1), and the velocity is corrected by the prediction error
+ * with gain 1 / 2^TRACKER_BETA_SHIFT. If the measurement deviates from the prediction by more than a quarter tone
+ * (a new note or a different octave), or the previous measurement is too old, the velocity is reset.
+ *
+ * @param tracker Pointer to the tracker state.
+ * @param frequency The measured frequency, Hz.
+ * @param timestamp The time of the measurement, us.
+ */
+void update_pitch_tracker(struct pitch_tracker *tracker, float frequency, uint32_t timestamp);
+
+/**
+ * @brief Extrapolates the frequency from the last measurement.
+ *
+ * The extrapolation stops TRACKER_MAX_EXTRAPOLATION_US after the last measurement, holding the last value.
+ *
+ * @param tracker Pointer to the tracker state.
+ * @param timestamp The time to extrapolate to, us.
+ *
+ * @return The extrapolated frequency in Hz, or 0 if there was no measurement yet.
+ */
+float predict_pitch(struct pitch_tracker *tracker, uint32_t timestamp);
+
+#endif
@@ -0,0 +1,61 @@
+#include "profile.h"
+
+const struct analysis_profile profiles[PROFILE_COUNT] = {
+    [PROFILE_BASS] = {"bass", 36.0, NUM_SAMPLES, SHIFT_LIMIT},
+    [PROFILE_GUITAR_DROP] = {"guitar_drop", 71.33, 960, 710},         // D2 73.42Hz / 1.0293
+    [PROFILE_GUITAR_STANDARD] = {"guitar_standard", 80.07, 885, 635}, // E2 82.41Hz / 1.0293
+    [PROFILE_VIOLIN] = {"violin", 190.42, 535, 285},                  // G3 196.00Hz / 1.0293
+    [PROFILE_UKULELE] = {"ukulele", 254.18, 470, 220},                // C4 261.63Hz / 1.0293
+};
+
+enum profile_id active_profile = DEFAULT_PROFILE;
+
+static uint8_t confident_notes = 0;
+static uint8_t missed_frames = 0;
+static float lowest_confident_freq;
+
+void update_profile(float frequency, uint8_t peak_count)
+{
+    if (!AUTO_PROFILE)
+        return;
+
+    if (peak_count == 0)
+    {
+        if (++missed_frames >= AUTO_PROFILE_MISSES)
+        {
+            active_profile = PROFILE_BASS;
+            missed_frames = 0;
+            confident_notes = 0;
+        }
+        return;
+    }
+    missed_frames = 0;
+
+    // Out-of-range note, widen immediately
+    if (frequency < profiles[active_profile].lowest_freq)
+    {
+        active_profile = PROFILE_BASS;
+        confident_notes = 0;
+        return;
+    }
+
+    if (peak_count < MIN_CONFIDENT_PEAKS)
+        return;
+
+    if (confident_notes == 0 || frequency < lowest_confident_freq)
+        lowest_confident_freq = frequency;
+
+    if (++confident_notes < AUTO_PROFILE_NOTES)
+        return;
+
+    // Select the tightest profile covering all the notes observed
+    for (enum profile_id id = PROFILE_COUNT - 1; id > PROFILE_BASS; id--)
+    {
+        if (profiles[id].lowest_freq <= lowest_confident_freq)
+        {
+            active_profile = id;
+            break;
+        }
+    }
+    confident_notes = 0;
+}
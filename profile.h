@@ -0,0 +1,53 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "macros.h"
+
+/**
+ * @brief Instrument profiles, ordered from the widest (most expensive) to the tightest.
+ */
+enum profile_id
+{
+    PROFILE_BASS,            // Also covers any instrument, the analysis as configured by NUM_SAMPLES and SHIFT_LIMIT
+    PROFILE_GUITAR_DROP,     // Guitar tuned down to drop D (D2)
+    PROFILE_GUITAR_STANDARD, // Guitar in standard tuning (E2)
+    PROFILE_VIOLIN,          // Violin (G3), also low-G ukulele
+    PROFILE_UKULELE,         // Ukulele in standard re-entrant tuning (C4)
+    PROFILE_COUNT
+};
+
+/**
+ * @brief Analysis parameters of an instrument profile.
+ *
+ * The lag range covers about 1.1 periods of the lowest note (quarter tone flat) plus the peak search margin,
+ * and the window is longer than the lag range by the same overlap as NUM_SAMPLES and SHIFT_LIMIT.
+ */
+struct analysis_profile
+{
+    const char *name;
+    float lowest_freq;    // Lowest frequency the profile can detect, Hz
+    uint16_t num_samples; // Analysis window length
+    uint16_t shift_limit; // Max phase shift to investigate
+};
+
+extern const struct analysis_profile profiles[PROFILE_COUNT];
+
+// Profile used for the analysis of the next frame
+extern enum profile_id active_profile;
+
+/**
+ * @brief Updates the active profile based on the latest analysis result.
+ *
+ * If AUTO_PROFILE is disabled, the profile stays at DEFAULT_PROFILE.
+ * Otherwise, after AUTO_PROFILE_NOTES confident results (at least MIN_CONFIDENT_PEAKS peaks, i.e. the period and its
+ * multiples all cancel out), the tightest profile that covers the lowest of these notes is selected.
+ * The widest profile is restored as soon as a note below the range of the active profile is detected,
+ * or if AUTO_PROFILE_MISSES consecutive frames do not produce any peak, as a note below the lag range can not be detected.
+ *
+ * @param frequency The frequency calculated from the last frame.
+ * @param peak_count The number of peaks identified in the last frame.
+ */
+void update_profile(float frequency, uint8_t peak_count);
+
+#endif
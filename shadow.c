@@ -0,0 +1,103 @@
+#include "shadow.h"
+#include <math.h>
+#include <string.h>
+#include "hardware/sync.h"
+#include "stats.h"
+#include "perf_counters.h"
+
+static struct shadow_request request;
+static volatile bool request_pending = false;
+static uint32_t analyzed_frames = 0;
+
+void shadow_submit(uint8_t samples[], uint16_t num_samples, uint16_t shift_limit, float frequency, uint8_t peak_count)
+{
+    if (++analyzed_frames % SHADOW_INTERVAL != 0)
+        return;
+    if (request_pending)
+    {
+        stats.shadow_skipped_frames++;
+        return;
+    }
+
+    memcpy(request.samples, samples, num_samples);
+    request.num_samples = num_samples;
+    request.shift_limit = shift_limit;
+    request.frequency = frequency;
+    request.peak_count = peak_count;
+    request.frame = stats.frames;
+
+    // The request must be complete before core 1 sees it pending
+    __dmb();
+    request_pending = true;
+}
+
+// Prints a frame with both results
+static void log_shadow_frame(const char *verdict, float frequency, uint8_t peak_count, float cents)
+{
+    // Skipped while core 0 prints the metrics response
+    if (!console_try_lock())
+        return;
+    printf("SHADOW frame %lu %s: primary %fHz (%u peaks), shadow %fHz (%u peaks), %.1f cents\n",
+           (unsigned long)request.frame, verdict,
+           request.frequency, request.peak_count,
+           frequency, peak_count, cents);
+    console_unlock();
+}
+
+static void compare_results(float frequency, uint8_t peak_count)
+{
+    if (request.peak_count == 0 && peak_count == 0)
+    {
+        if (SHADOW_LOG_ALL)
+            log_shadow_frame("unpitched", frequency, peak_count, 0);
+        return;
+    }
+    if (request.peak_count == 0 || peak_count == 0)
+    {
+        stats.shadow_misses++;
+        log_shadow_frame("miss", frequency, peak_count, 0);
+        return;
+    }
+
+    float cents = 1200 * log2f(frequency / request.frequency);
+    float octave_cents = cents - 1200 * roundf(cents / 1200);
+    if (fabsf(cents) < SHADOW_AGREEMENT_CENTS)
+    {
+        stats.shadow_agreements++;
+        stats.shadow_agreement_deviation += fabsf(cents);
+        if (SHADOW_LOG_ALL)
+            log_shadow_frame("agree", frequency, peak_count, cents);
+    }
+    else if (fabsf(octave_cents) < SHADOW_AGREEMENT_CENTS)
+    {
+        stats.shadow_octave_errors++;
+        log_shadow_frame("octave", frequency, peak_count, cents);
+    }
+    else
+    {
+        stats.shadow_disagreements++;
+        log_shadow_frame("disagree", frequency, peak_count, cents);
+    }
+}
+
+bool shadow_run()
+{
+    if (!request_pending)
+        return false;
+    // Do not read the request before seeing it pending
+    __dmb();
+
+    struct perf_snapshot perf;
+    uint8_t peak_count = 0;
+    perf_begin(&perf);
+    float frequency = freq_engines[SHADOW_ENGINE](request.samples, request.num_samples, request.shift_limit, &peak_count);
+    perf_end(&perf, PERF_STAGE_SHADOW);
+
+    stats.shadow_frames++;
+    compare_results(frequency, peak_count);
+
+    // The request may be overwritten once it is not pending
+    __dmb();
+    request_pending = false;
+    return true;
+}
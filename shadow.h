@@ -0,0 +1,50 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "macros.h"
+#include "freq_analysis.h"
+
+/**
+ * @brief A frame submitted to the shadow engine, with the result of the primary one.
+ *
+ * Filled by core 0 while no request is pending, analyzed by core 1 in its idle time.
+ */
+struct shadow_request
+{
+    uint8_t samples[NUM_SAMPLES]; // Smoothed (and preconditioned) samples of the frame
+    uint16_t num_samples;         // Analysis window length of the active profile
+    uint16_t shift_limit;         // Shift limit of the active profile
+    float frequency;              // Result of the primary engine
+    uint8_t peak_count;           // Peak count of the primary engine
+    uint32_t frame;               // Number of the frame, to identify it in the log
+};
+
+/**
+ * @brief Submits every SHADOW_INTERVAL-th analyzed frame to the shadow engine.
+ *
+ * The samples are copied, so the buffer may be overwritten right after. If the shadow engine has not finished
+ * the previous frame yet, the frame is counted as skipped. Called by core 0.
+ *
+ * @param samples The smoothed samples of the frame.
+ * @param num_samples The number of samples (analysis window length).
+ * @param shift_limit Max phase shift investigated.
+ * @param frequency The result of the primary engine.
+ * @param peak_count The peak count of the primary engine.
+ */
+void shadow_submit(uint8_t samples[], uint16_t num_samples, uint16_t shift_limit, float frequency, uint8_t peak_count);
+
+/**
+ * @brief Analyzes the pending frame with SHADOW_ENGINE, and compares the result with the primary one.
+ *
+ * Results within SHADOW_AGREEMENT_CENTS agree, results an integer number of octaves apart are octave errors,
+ * others disagree. Frames where only one of the engines found a pitch are counted separately.
+ * Every frame not agreeing (every frame with SHADOW_LOG_ALL) is printed to the console.
+ * The displayed result is not affected. Called by core 1.
+ *
+ * @return true if a pending frame has been analyzed.
+ */
+bool shadow_run();
+
+#endif
@@ -0,0 +1,418 @@
+#include "stats.h"
+#include "pico/mutex.h"
+
+struct tuner_stats stats;
+
+// Held by print_metrics, so the prints of core 1 do not interleave with the response
+auto_init_mutex(console_mutex);
+
+static const char *stage_names[PERF_STAGE_COUNT] = {
+    [PERF_STAGE_SMOOTHING] = "smoothing",
+    [PERF_STAGE_GATE] = "gate",
+    [PERF_STAGE_ANALYSIS] = "analysis",
+    [PERF_STAGE_HANDOFF] = "handoff",
+    [PERF_STAGE_PROVISIONAL] = "provisional",
+    [PERF_STAGE_SHADOW] = "shadow",
+};
+
+static uint32_t last_report_time_us = 0;
+static uint32_t last_report_frames = 0;
+
+// Soak monitoring window, reset by each report
+static uint32_t window_frame_time[FRAME_TIME_BUCKETS];
+static uint32_t window_frames = 0;
+static uint64_t window_frame_time_us = 0;
+static uint32_t window_max_frame_time = 0;
+static uint32_t window_missed_deadlines = 0;
+static uint32_t window_start_handoff_stalls = 0;
+
+// Mean frame time of the last windows, oldest first
+static uint32_t trend_frame_time[SOAK_TREND_WINDOWS];
+static uint8_t trend_windows = 0;
+static uint32_t reported_stack_high_water = 0;
+
+// The core 0 stack grows down from __StackTop through the free part of SCRATCH_Y (symbols of the SDK linker script)
+extern uint32_t __scratch_y_end__;
+extern uint32_t __StackTop;
+#define STACK_PAINT 0x5354414Bu
+#define STACK_PAINT_MARGIN 16 // Words left unpainted below the frame of stats_paint_stack
+
+void stats_record_restart_gap(uint32_t gap_samples)
+{
+    stats.restart_gap_samples += gap_samples;
+    if (gap_samples > stats.max_restart_gap)
+        stats.max_restart_gap = gap_samples;
+}
+
+void stats_record_refresh_lateness(uint32_t lateness_us)
+{
+    uint32_t bucket = lateness_us / REFRESH_LATENESS_BUCKET_US;
+    stats.refresh_lateness[bucket < REFRESH_LATENESS_BUCKETS ? bucket : REFRESH_LATENESS_BUCKETS - 1]++;
+    stats.display_refreshes++;
+    if (lateness_us > stats.max_refresh_lateness)
+        stats.max_refresh_lateness = lateness_us;
+}
+
+void stats_record_analysis_time(uint32_t time_us)
+{
+    uint32_t bucket = time_us / ANALYSIS_TIME_BUCKET_US;
+    stats.analysis_time[bucket < ANALYSIS_TIME_BUCKETS ? bucket : ANALYSIS_TIME_BUCKETS - 1]++;
+    stats.analysis_time_us += time_us;
+}
+
+void stats_record_frame_time(uint32_t time_us, bool missed_deadline)
+{
+    uint32_t bucket = time_us / FRAME_TIME_BUCKET_US;
+    window_frame_time[bucket < FRAME_TIME_BUCKETS ? bucket : FRAME_TIME_BUCKETS - 1]++;
+    window_frames++;
+    window_frame_time_us += time_us;
+    if (time_us > window_max_frame_time)
+        window_max_frame_time = time_us;
+    if (time_us > stats.max_frame_time)
+        stats.max_frame_time = time_us;
+    if (missed_deadline)
+    {
+        stats.missed_deadlines++;
+        window_missed_deadlines++;
+    }
+}
+
+void stats_paint_stack()
+{
+    uint32_t marker;
+    for (volatile uint32_t *word = &__scratch_y_end__; word < &marker - STACK_PAINT_MARGIN; word++)
+    {
+        *word = STACK_PAINT;
+    }
+}
+
+// Bytes of the core 0 stack used since it was painted. The free part of SCRATCH_Y used entirely means the stack
+// may have grown into SCRATCH_X.
+static uint32_t stack_high_water()
+{
+    const uint32_t *word = &__scratch_y_end__;
+    while (word < &__StackTop && *word == STACK_PAINT)
+        word++;
+    return (&__StackTop - word) * sizeof(uint32_t);
+}
+
+// Upper bound of the value of the given percentage of the histogram entries, us
+static uint32_t histogram_percentile(const uint32_t histogram[], uint8_t buckets, uint32_t bucket_us, uint32_t count,
+                                     uint32_t max, uint8_t percent)
+{
+    uint64_t target = (uint64_t)count * percent;
+    uint64_t entries = 0;
+    for (uint8_t bucket = 0; bucket < buckets - 1; bucket++)
+    {
+        entries += histogram[bucket];
+        if (entries * 100 >= target)
+            return (bucket + 1) * bucket_us;
+    }
+    return max;
+}
+
+// Upper bound of the lateness of the given percentage of the refreshes, us
+static uint32_t refresh_lateness_percentile(uint8_t percent)
+{
+    return histogram_percentile(stats.refresh_lateness, REFRESH_LATENESS_BUCKETS, REFRESH_LATENESS_BUCKET_US,
+                                stats.display_refreshes, stats.max_refresh_lateness, percent);
+}
+
+// Rise of the least squares line fitted to the values, from the first to the last one
+static float trend_rise(const uint32_t values[], uint8_t count, float mean)
+{
+    float center = (count - 1) / 2.0f;
+    float covariance = 0;
+    float variance = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        covariance += (i - center) * (values[i] - mean);
+        variance += (i - center) * (i - center);
+    }
+    return covariance / variance * (count - 1);
+}
+
+static void print_soak_stats()
+{
+    uint32_t stack = stack_high_water();
+    printf("STATS soak frame_time p50: %luus, p99: %luus, max: %luus, missed_deadlines: %lu, handoff_stalls: %lu, stack_high_water: %luB of %luB\n",
+           (unsigned long)histogram_percentile(window_frame_time, FRAME_TIME_BUCKETS, FRAME_TIME_BUCKET_US, window_frames, window_max_frame_time, 50),
+           (unsigned long)histogram_percentile(window_frame_time, FRAME_TIME_BUCKETS, FRAME_TIME_BUCKET_US, window_frames, window_max_frame_time, 99),
+           (unsigned long)window_max_frame_time,
+           (unsigned long)window_missed_deadlines,
+           (unsigned long)(stats.handoff_stalls - window_start_handoff_stalls),
+           (unsigned long)stack,
+           (unsigned long)((&__StackTop - &__scratch_y_end__) * sizeof(uint32_t)));
+
+    if (window_frames)
+    {
+        if (trend_windows == SOAK_TREND_WINDOWS)
+        {
+            for (uint8_t i = 1; i < SOAK_TREND_WINDOWS; i++)
+            {
+                trend_frame_time[i - 1] = trend_frame_time[i];
+            }
+            trend_windows--;
+        }
+        trend_frame_time[trend_windows++] = window_frame_time_us / window_frames;
+    }
+    if (trend_windows == SOAK_TREND_WINDOWS)
+    {
+        float mean = 0;
+        for (uint8_t i = 0; i < SOAK_TREND_WINDOWS; i++)
+        {
+            mean += trend_frame_time[i];
+        }
+        mean /= SOAK_TREND_WINDOWS;
+        float rise = trend_rise(trend_frame_time, SOAK_TREND_WINDOWS, mean);
+        if (rise * 100 > mean * SOAK_TREND_PERCENT)
+        {
+            stats.soak_regressions++;
+            printf("STATS soak REGRESSION mean frame_time rising by %luus over the last %u windows, mean: %luus\n",
+                   (unsigned long)rise, SOAK_TREND_WINDOWS, (unsigned long)mean);
+        }
+    }
+    // The first report sets the baseline, later growth is reported once
+    if (reported_stack_high_water && stack > reported_stack_high_water)
+    {
+        stats.soak_regressions++;
+        printf("STATS soak REGRESSION stack_high_water grew from %luB to %luB\n",
+               (unsigned long)reported_stack_high_water, (unsigned long)stack);
+    }
+    if (stack > reported_stack_high_water)
+        reported_stack_high_water = stack;
+
+    for (uint8_t bucket = 0; bucket < FRAME_TIME_BUCKETS; bucket++)
+    {
+        window_frame_time[bucket] = 0;
+    }
+    window_frames = 0;
+    window_frame_time_us = 0;
+    window_max_frame_time = 0;
+    window_missed_deadlines = 0;
+    window_start_handoff_stalls = stats.handoff_stalls;
+}
+
+static void print_stage_stats()
+{
+    printf("STATS %-10s %10s %12s %10s\n", "stage", "count", "cycles/call", "xip_hit%");
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++)
+    {
+        struct stage_stats *stage = &stats.stages[i];
+        if (stage->count == 0)
+            continue;
+
+        printf("STATS %-10s %10lu %12lu ", stage_names[i], (unsigned long)stage->count, (unsigned long)(stage->cycles / stage->count));
+        // The XIP cache may be disabled, or the stage may run from RAM entirely
+        if (stage->xip_accesses)
+            printf("%10lu\n", (unsigned long)(stage->xip_hits * 100 / stage->xip_accesses));
+        else
+            printf("%10s\n", "n/a");
+    }
+    // The provisional analysis is booked to its own stage, its samples are excluded from the analysis ratio
+    uint64_t analysis_samples = accumulated_samples[0] - stats.provisional_samples;
+    if (analysis_samples)
+        printf("STATS analysis cycles/accumulated_sample: %lu.%02lu\n",
+               (unsigned long)(stats.stages[PERF_STAGE_ANALYSIS].cycles / analysis_samples),
+               (unsigned long)(stats.stages[PERF_STAGE_ANALYSIS].cycles * 100 / analysis_samples % 100));
+    if (stats.provisional_samples)
+        printf("STATS provisional cycles/accumulated_sample: %lu.%02lu\n",
+               (unsigned long)(stats.stages[PERF_STAGE_PROVISIONAL].cycles / stats.provisional_samples),
+               (unsigned long)(stats.stages[PERF_STAGE_PROVISIONAL].cycles * 100 / stats.provisional_samples % 100));
+    uint64_t shadow_samples = read_accumulated_samples(1);
+    if (shadow_samples)
+        printf("STATS shadow cycles/accumulated_sample: %lu.%02lu\n",
+               (unsigned long)(stats.stages[PERF_STAGE_SHADOW].cycles / shadow_samples),
+               (unsigned long)(stats.stages[PERF_STAGE_SHADOW].cycles * 100 / shadow_samples % 100));
+}
+
+static void print_shadow_stats()
+{
+    uint32_t pitched = stats.shadow_agreements + stats.shadow_octave_errors + stats.shadow_disagreements + stats.shadow_misses;
+    printf("STATS shadow_frames: %lu, shadow_skipped_frames: %lu, agreements: %lu, octave_errors: %lu, disagreements: %lu, misses: %lu\n",
+           (unsigned long)stats.shadow_frames,
+           (unsigned long)stats.shadow_skipped_frames,
+           (unsigned long)stats.shadow_agreements,
+           (unsigned long)stats.shadow_octave_errors,
+           (unsigned long)stats.shadow_disagreements,
+           (unsigned long)stats.shadow_misses);
+    if (pitched)
+        printf("STATS shadow agreement: %lu%%, avg_deviation: %.2f cents\n",
+               (unsigned long)(stats.shadow_agreements * 100 / pitched),
+               stats.shadow_agreements ? stats.shadow_agreement_deviation / stats.shadow_agreements : 0.0f);
+}
+
+void print_stats(uint32_t time_us)
+{
+    uint32_t elapsed_us = time_us - last_report_time_us;
+    if (elapsed_us)
+        printf("STATS frames/s: %lu.%01lu\n",
+               (unsigned long)((uint64_t)(stats.frames - last_report_frames) * 1000000 / elapsed_us),
+               (unsigned long)((uint64_t)(stats.frames - last_report_frames) * 10000000 / elapsed_us % 10));
+    last_report_time_us = time_us;
+    last_report_frames = stats.frames;
+
+    printf("STATS frames: %lu, gated_frames: %lu, adc_fifo_overflows: %lu, adc_errors: %lu, discontinuous_frames: %lu\n",
+           (unsigned long)stats.frames,
+           (unsigned long)stats.gated_frames,
+           (unsigned long)stats.adc_fifo_overflows,
+           (unsigned long)stats.adc_errors,
+           (unsigned long)stats.discontinuous_frames);
+    printf("STATS restart_gap_samples: %lu, max_restart_gap: %lu, avg_restart_gap: %lu\n",
+           (unsigned long)stats.restart_gap_samples,
+           (unsigned long)stats.max_restart_gap,
+           (unsigned long)(stats.frames ? stats.restart_gap_samples / stats.frames : 0));
+    printf("STATS accumulated_samples: %llu, provisional_samples: %llu, avg_accumulated_samples: %lu\n",
+           (unsigned long long)accumulated_samples[0],
+           (unsigned long long)stats.provisional_samples,
+           (unsigned long)(stats.frames ? (accumulated_samples[0] - stats.provisional_samples) / stats.frames : 0));
+    printf("STATS profile: %s", profiles[active_profile].name);
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++)
+    {
+        printf(", %s_frames: %lu", profiles[i].name, (unsigned long)stats.profile_frames[i]);
+    }
+    printf("\n");
+    printf("STATS provisional_results: %lu\n", (unsigned long)stats.provisional_results);
+    if (SUBSAMPLED_INTERFERENCE)
+        printf("STATS subsample screened_shifts: %lu, exact_shifts: %lu, bound_violations: %lu, audited_shifts: %lu, screen_misses: %lu\n",
+               (unsigned long)subsample_stats[0].screened_shifts,
+               (unsigned long)subsample_stats[0].exact_shifts,
+               (unsigned long)subsample_stats[0].bound_violations,
+               (unsigned long)subsample_stats[0].audited_shifts,
+               (unsigned long)subsample_stats[0].screen_misses);
+    if (SHADOW_MODE)
+        print_shadow_stats();
+    if (stats.display_refreshes)
+        printf("STATS display_refreshes: %lu, refresh_lateness p50: %luus, p99: %luus, max: %luus\n",
+               (unsigned long)stats.display_refreshes,
+               (unsigned long)refresh_lateness_percentile(50),
+               (unsigned long)refresh_lateness_percentile(99),
+               (unsigned long)stats.max_refresh_lateness);
+    if (SINGLE_CORE)
+        printf("STATS max_service_interval: %luus\n", (unsigned long)stats.max_service_interval);
+    if (SOAK_MONITOR)
+        print_soak_stats();
+    print_stage_stats();
+}
+
+static void print_metric(const char *name, const char *type, const char *help)
+{
+    printf("# HELP tuner_%s %s\n# TYPE tuner_%s %s\n", name, help, name, type);
+}
+
+static void print_counter(const char *name, const char *help, uint64_t value)
+{
+    print_metric(name, "counter", help);
+    printf("tuner_%s %llu\n", name, (unsigned long long)value);
+}
+
+bool console_try_lock()
+{
+    return mutex_try_enter(&console_mutex, NULL);
+}
+
+void console_unlock()
+{
+    mutex_exit(&console_mutex);
+}
+
+void print_metrics(uint64_t time_us)
+{
+    mutex_enter_blocking(&console_mutex);
+    printf(METRICS_BEGIN_LINE "\n");
+
+    print_metric("uptime_seconds", "gauge", "Time since power-up.");
+    printf("tuner_uptime_seconds %llu.%03llu\n", (unsigned long long)(time_us / 1000000), (unsigned long long)(time_us / 1000 % 1000));
+
+    print_counter("frames_total", "Frames analyzed.", stats.frames);
+    print_counter("gated_frames_total", "Frames skipped by the noise gate.", stats.gated_frames);
+    print_counter("discontinuous_frames_total", "Frames analyzed despite lost samples.", stats.discontinuous_frames);
+    print_metric("dropped_total", "counter", "Frames or samples lost, by reason.");
+    printf("tuner_dropped_total{reason=\"adc_fifo_overflow\"} %lu\n", (unsigned long)stats.adc_fifo_overflows);
+    printf("tuner_dropped_total{reason=\"adc_error\"} %lu\n", (unsigned long)stats.adc_errors);
+    printf("tuner_dropped_total{reason=\"shadow_busy\"} %lu\n", (unsigned long)stats.shadow_skipped_frames);
+    print_counter("restart_gap_samples_total", "Samples skipped between the captures.", stats.restart_gap_samples);
+    print_counter("provisional_results_total", "Provisional results published.", stats.provisional_results);
+    print_counter("provisional_accumulated_samples_total", "Samples accumulated by the provisional analysis, included in accumulated_samples_total.",
+                  stats.provisional_samples);
+    print_counter("handoff_stalls_total", "Results published while the multicore FIFO was full.", stats.handoff_stalls);
+    if (SOAK_MONITOR)
+    {
+        print_counter("missed_deadlines_total", "Frames after which core 0 did not keep up with the ADC.", stats.missed_deadlines);
+        print_counter("soak_regressions_total", "Report windows with an upward trend.", stats.soak_regressions);
+        print_metric("stack_high_water_bytes", "gauge", "Core 0 stack used since power-up.");
+        printf("tuner_stack_high_water_bytes %lu\n", (unsigned long)stack_high_water());
+    }
+
+    print_metric("analysis_seconds", "histogram", "Full analysis time per frame.");
+    uint32_t frames = 0;
+    for (uint8_t bucket = 0; bucket < ANALYSIS_TIME_BUCKETS - 1; bucket++)
+    {
+        frames += stats.analysis_time[bucket];
+        uint32_t bound_us = (bucket + 1) * ANALYSIS_TIME_BUCKET_US;
+        printf("tuner_analysis_seconds_bucket{le=\"%lu.%06lu\"} %lu\n",
+               (unsigned long)(bound_us / 1000000), (unsigned long)(bound_us % 1000000), (unsigned long)frames);
+    }
+    frames += stats.analysis_time[ANALYSIS_TIME_BUCKETS - 1];
+    printf("tuner_analysis_seconds_bucket{le=\"+Inf\"} %lu\n", (unsigned long)frames);
+    printf("tuner_analysis_seconds_sum %llu.%06llu\n",
+           (unsigned long long)(stats.analysis_time_us / 1000000), (unsigned long long)(stats.analysis_time_us % 1000000));
+    printf("tuner_analysis_seconds_count %lu\n", (unsigned long)frames);
+
+    // Per-core counters, merged on read
+    uint64_t calculations = 0;
+    uint64_t aborts = 0;
+    print_metric("accumulated_samples_total", "counter", "Samples accumulated by the interference and NSDF calculations.");
+    for (uint8_t core = 0; core < NUM_CORES; core++)
+    {
+        printf("tuner_accumulated_samples_total{core=\"%u\"} %llu\n", core, (unsigned long long)read_accumulated_samples(core));
+    }
+    print_metric("interference_shifts_total", "counter", "Shifts whose interference power was calculated.");
+    for (uint8_t core = 0; core < NUM_CORES; core++)
+    {
+        calculations += interference_stats[core].calculations;
+        printf("tuner_interference_shifts_total{core=\"%u\"} %lu\n", core, (unsigned long)interference_stats[core].calculations);
+    }
+    print_metric("interference_aborts_total", "counter", "Interference calculations aborted on exceeding the threshold.");
+    for (uint8_t core = 0; core < NUM_CORES; core++)
+    {
+        aborts += interference_stats[core].aborts;
+        printf("tuner_interference_aborts_total{core=\"%u\"} %lu\n", core, (unsigned long)interference_stats[core].aborts);
+    }
+    print_metric("interference_abort_ratio", "gauge", "Share of the interference calculations aborted early, both cores.");
+    printf("tuner_interference_abort_ratio %.4f\n", calculations ? (float)aborts / calculations : 0.0f);
+    if (SUBSAMPLED_INTERFERENCE)
+    {
+        uint64_t screened = 0, audited = 0, misses = 0;
+        for (uint8_t core = 0; core < NUM_CORES; core++)
+        {
+            screened += subsample_stats[core].screened_shifts;
+            audited += subsample_stats[core].audited_shifts;
+            misses += subsample_stats[core].screen_misses;
+        }
+        print_counter("subsample_screened_shifts_total", "Shifts rejected from the subsampled estimate alone.", screened);
+        print_counter("subsample_audited_shifts_total", "Screened shifts calculated exactly to audit the screening.", audited);
+        print_counter("subsample_screen_misses_total", "Audited shifts found not to exceed the threshold.", misses);
+    }
+
+    print_metric("stage_cycles_total", "counter", "System clock cycles spent in each stage.");
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++)
+    {
+        printf("tuner_stage_cycles_total{stage=\"%s\"} %llu\n", stage_names[i], (unsigned long long)stats.stages[i].cycles);
+    }
+    print_metric("stage_calls_total", "counter", "Executions of each stage.");
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++)
+    {
+        printf("tuner_stage_calls_total{stage=\"%s\"} %lu\n", stage_names[i], (unsigned long)stats.stages[i].count);
+    }
+
+    print_counter("display_refreshes_total", "Predictive display refreshes.", stats.display_refreshes);
+    print_metric("profile_frames_total", "counter", "Frames analyzed under each instrument profile.");
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++)
+    {
+        printf("tuner_profile_frames_total{profile=\"%s\"} %lu\n", profiles[i].name, (unsigned long)stats.profile_frames[i]);
+    }
+
+    printf(METRICS_END_LINE "\n");
+    mutex_exit(&console_mutex);
+}
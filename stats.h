@@ -0,0 +1,172 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "macros.h"
+#include "profile.h"
+#include "freq_analysis.h"
+
+// Histogram of the display refresh lateness
+#define REFRESH_LATENESS_BUCKETS 64
+#define REFRESH_LATENESS_BUCKET_US 50
+
+// Histogram of the frame time within a soak monitoring window (SOAK_MONITOR)
+#define FRAME_TIME_BUCKETS 64
+#define FRAME_TIME_BUCKET_US 500
+
+// Histogram of the full analysis time, up to 64 ms. A full window with no shift aborted accumulates about 1.1 M samples, some 60 ms.
+#define ANALYSIS_TIME_BUCKETS 32
+#define ANALYSIS_TIME_BUCKET_US 2000
+
+/**
+ * @brief Stages of the core 0 loop, measured separately.
+ */
+enum perf_stage
+{
+    PERF_STAGE_SMOOTHING,   // Copying the samples with SMA smoothing (and preconditioning)
+    PERF_STAGE_GATE,        // Noise gate
+    PERF_STAGE_ANALYSIS,    // Frequency estimation, including the peak search
+    PERF_STAGE_HANDOFF,     // Passing the result to core 1
+    PERF_STAGE_PROVISIONAL, // Provisional analysis of the beginning of the capture (DUAL_WINDOW)
+    PERF_STAGE_SHADOW,      // Shadow engine analysis on core 1 (SHADOW_MODE)
+    PERF_STAGE_COUNT
+};
+
+/**
+ * @brief Hardware counters accumulated over all executions of a stage.
+ *
+ * The XIP cache counters are global, so while a stage runs they also count the fetches of the other core
+ * (the display and shadow code of core 1). The hit ratio of a stage is only exact while the other core is idle.
+ */
+struct stage_stats
+{
+    uint64_t cycles;       // System clock cycles
+    uint64_t xip_hits;     // XIP cache hits of both cores, a low hit ratio means the stage waits for code fetched from flash
+    uint64_t xip_accesses; // XIP cache accesses of both cores
+    uint32_t count;        // Number of executions
+};
+
+/**
+ * @brief Acquisition and analysis counters.
+ *
+ * The counters are accumulated by core 0 (the shadow and display ones by core 1) since power-up and periodically printed to the console,
+ * so buffer sizes and the analysis rate can be tuned from the data gathered on a real device.
+ */
+struct tuner_stats
+{
+    uint32_t frames;               // Frames analyzed
+    uint32_t gated_frames;         // Frames skipped by the noise gate
+    uint32_t adc_fifo_overflows;   // Frames during which the ADC FIFO overflowed (samples were lost)
+    uint32_t adc_errors;           // Frames during which the ADC reported a conversion error
+    uint32_t discontinuous_frames; // Frames analyzed despite a gap or an error within the captured samples
+    uint32_t restart_gap_samples;  // Samples skipped between the end of a capture and the DMA restart
+    uint32_t max_restart_gap;      // The longest gap observed between two captures, in samples
+    uint32_t profile_frames[PROFILE_COUNT]; // Frames analyzed under each instrument profile
+    uint32_t provisional_results;  // Provisional results published ahead of the full analysis
+    uint64_t provisional_samples;  // Samples accumulated by the provisional analysis, a part of accumulated_samples[0]
+    uint32_t shadow_frames;        // Frames analyzed by the shadow engine (SHADOW_MODE)
+    uint32_t shadow_skipped_frames; // Frames due for the shadow engine, skipped as it was still busy
+    uint32_t shadow_agreements;    // Frames on which both engines agreed within SHADOW_AGREEMENT_CENTS
+    uint32_t shadow_octave_errors; // Frames on which the engines disagreed by a multiple of an octave
+    uint32_t shadow_disagreements; // Frames on which the engines disagreed otherwise
+    uint32_t shadow_misses;        // Frames on which only one of the engines found a pitch
+    float shadow_agreement_deviation; // Sum of absolute deviations of the agreeing results, cents
+    uint32_t display_refreshes;    // Predictive display refreshes
+    uint32_t refresh_lateness[REFRESH_LATENESS_BUCKETS]; // Refreshes per lateness, the last bucket also counts the later ones
+    uint32_t max_refresh_lateness; // The latest refresh observed, us
+    uint32_t max_service_interval; // The longest interval between the task servicing calls with SINGLE_CORE, us
+    uint32_t handoff_stalls;       // Results published while the multicore FIFO was full, the core 0 loop waited for core 1
+    uint32_t analysis_time[ANALYSIS_TIME_BUCKETS]; // Frames per analysis time, the last bucket also counts the longer ones
+    uint64_t analysis_time_us;     // Total analysis time, us
+    uint32_t missed_deadlines;     // Frames after which the next capture had completed before core 0 was ready for it (SOAK_MONITOR)
+    uint32_t max_frame_time;       // The longest core 0 loop iteration observed, from the end of a capture, us (SOAK_MONITOR)
+    uint32_t soak_regressions;     // Report windows in which an upward trend was detected (SOAK_MONITOR)
+    struct stage_stats stages[PERF_STAGE_COUNT];
+};
+
+extern struct tuner_stats stats;
+
+/**
+ * @brief Records the number of samples skipped between two consecutive captures.
+ *
+ * @param gap_samples The number of samples the ADC converted while the DMA was stopped.
+ */
+void stats_record_restart_gap(uint32_t gap_samples);
+
+/**
+ * @brief Records how late a predictive display refresh was, compared with its schedule.
+ *
+ * @param lateness_us The time elapsed since the refresh was due, us.
+ */
+void stats_record_refresh_lateness(uint32_t lateness_us);
+
+/**
+ * @brief Records the time of the full analysis of a frame.
+ *
+ * @param time_us The analysis time, us.
+ */
+void stats_record_analysis_time(uint32_t time_us);
+
+/**
+ * @brief Records the time core 0 spent on a frame, from the end of its capture until it is ready for the next one.
+ *
+ * @param time_us The frame time, us.
+ * @param missed_deadline True if the next capture had already completed, i.e. core 0 did not keep up with the ADC.
+ */
+void stats_record_frame_time(uint32_t time_us, bool missed_deadline);
+
+/**
+ * @brief Fills the unused part of the core 0 stack with a pattern, for the stack high-water mark (SOAK_MONITOR).
+ *
+ * Must be called from main, before any deep call. The stack grows down through the free part of SCRATCH_Y,
+ * the high-water mark is the lowest word found overwritten when the stats are printed.
+ */
+void stats_paint_stack();
+
+/**
+ * @brief Prints all the counters to the console.
+ *
+ * The frame rate is calculated over the time elapsed since the previous report.
+ * Stage counters are reported per execution, analysis cycles also per accumulated sample.
+ * With SOAK_MONITOR, the frame time percentiles, missed deadlines and stack high-water mark of the frames since
+ * the previous report (the window) are printed, and a rising mean frame time over the last SOAK_TREND_WINDOWS windows,
+ * or a growing stack, is reported as a regression. The trend is meaningful for a repeated input, e.g. in a soak run
+ * with a looping recording.
+ *
+ * @param time_us The current time, us.
+ */
+void print_stats(uint32_t time_us);
+
+// Comment lines framing the metrics response, so a host script can cut it out of the console output
+#define METRICS_BEGIN_LINE "# BEGIN tuner_metrics"
+#define METRICS_END_LINE "# END tuner_metrics"
+
+/**
+ * @brief Takes the console for a print of core 1, unless the metrics response is being printed.
+ *
+ * Does not block, so it may be called from an interrupt handler. A print that can not take the console is skipped.
+ *
+ * @return true if the console has been taken, and must be released with console_unlock.
+ */
+bool console_try_lock();
+
+/**
+ * @brief Releases the console taken with console_try_lock.
+ */
+void console_unlock();
+
+/**
+ * @brief Prints all the counters to the console, in the Prometheus text exposition format.
+ *
+ * This is the metrics endpoint (METRICS_ENDPOINT), a host script can forward the response to a Prometheus scrape.
+ * The response is framed by METRICS_BEGIN_LINE and METRICS_END_LINE, and holds the console meanwhile, so the prints
+ * of core 1 do not interleave with it. All values are counters accumulated since power-up, the rates are calculated
+ * by the scraper. The per-core counters are written by their own core only, labelled with the core, and merged into
+ * the totals on read. The 64-bit ones are read through read_accumulated_samples, so they do not tear.
+ *
+ * @param time_us The time since power-up, us.
+ */
+void print_metrics(uint64_t time_us);
+
+#endif
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <string.h>
+#include "calibration.h"
+
+static int failures = 0;
+
+// The calibration is not stored by the test
+bool flash_storage_load(uint8_t sector, uint16_t version, void *data, uint16_t size)
+{
+    return false;
+}
+
+void flash_storage_store(uint8_t sector, uint16_t version, const void *data, uint16_t size)
+{
+}
+
+static void check_gate(uint32_t gate_threshold, uint16_t num_samples, uint32_t expected)
+{
+    calibration.gate_threshold = gate_threshold;
+    uint32_t gate = calibration_gate_threshold(num_samples);
+    if (gate != expected)
+    {
+        printf("FAIL gate %lu over %u samples is %lu, expected %lu\n", (unsigned long)gate_threshold, num_samples,
+               (unsigned long)gate, (unsigned long)expected);
+        failures++;
+    }
+}
+
+int main()
+{
+    // Gates below NUM_SAMPLES must not be truncated to 0 for a short window
+    check_gate(NUM_SAMPLES / 2, NUM_SAMPLES / 2, NUM_SAMPLES / 4);
+    check_gate(NUM_SAMPLES - 1, NUM_SAMPLES / 2, (NUM_SAMPLES - 1) / 2);
+    check_gate(100, NUM_SAMPLES / 3, 100 / 3);
+    check_gate(NUM_SAMPLES * 3 + 7, NUM_SAMPLES / 2, (NUM_SAMPLES * 3 + 7) / 2);
+
+    // Full window, and the largest gate a calibration can produce
+    check_gate(1234, NUM_SAMPLES, 1234);
+    check_gate(CALIBRATION_MAX_NOISE * NUM_SAMPLES * NOISE_GATE_RATIO, NUM_SAMPLES,
+               CALIBRATION_MAX_NOISE * NUM_SAMPLES * NOISE_GATE_RATIO);
+
+    // A calibrated gate rejects a short window of noise
+    uint8_t samples[NUM_SAMPLES];
+    calibration_begin();
+    for (uint16_t i = 0; i < NUM_SAMPLES; i++)
+    {
+        samples[i] = 128 + (i % 2 ? 1 : -1);
+    }
+    calibration_add_frame(samples, NUM_SAMPLES);
+    if (!calibration_finish())
+    {
+        printf("FAIL quiet calibration rejected\n");
+        failures++;
+    }
+    uint16_t num_samples = NUM_SAMPLES / 4;
+    if (calculate_signal_pwr(samples, num_samples, calibration.dc_bias) >= calibration_gate_threshold(num_samples))
+    {
+        printf("FAIL noise of a %u sample window passes the gate\n", num_samples);
+        failures++;
+    }
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures != 0;
+}
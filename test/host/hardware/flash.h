@@ -0,0 +1,8 @@
+// Host stand-in for the Pico SDK header, covering what the tested modules use
+#ifndef HOST_HARDWARE_FLASH_H
+#define HOST_HARDWARE_FLASH_H
+
+#define FLASH_PAGE_SIZE 256
+#define FLASH_SECTOR_SIZE 4096
+
+#endif
@@ -0,0 +1,14 @@
+// Host stand-in for the Pico SDK header, covering what the tested modules use
+#ifndef HOST_HARDWARE_SYNC_H
+#define HOST_HARDWARE_SYNC_H
+
+#include "pico/stdlib.h"
+
+uint get_core_num(void);
+
+// The tests are single threaded, no barrier is needed
+static inline void __dmb(void)
+{
+}
+
+#endif
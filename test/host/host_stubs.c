@@ -0,0 +1,22 @@
+#include "stats.h"
+
+// The tests run on a single host thread, standing for core 0
+uint get_core_num(void)
+{
+    return 0;
+}
+
+uint32_t time_us_32(void)
+{
+    return 0;
+}
+
+// Nothing else prints to the console of the tests
+bool console_try_lock()
+{
+    return true;
+}
+
+void console_unlock()
+{
+}
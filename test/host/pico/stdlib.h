@@ -0,0 +1,15 @@
+// Host stand-in for the Pico SDK header, covering what the tested modules use
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NUM_CORES 2
+#define __not_in_flash_func(x) x
+
+typedef unsigned int uint;
+
+uint32_t time_us_32(void);
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pitch_track.h"
+
+#define RECORD_COUNT (2 * PITCH_TRACK_BLOCK_RECORDS + 17)
+#define TRACK_WORDS (RECORD_COUNT * 32)
+
+static int failures = 0;
+
+// The blocks are collected in memory, word aligned as in a mapped file
+static uint32_t track_words[TRACK_WORDS];
+static uint8_t *track = (uint8_t *)track_words;
+static uint32_t track_size = 0;
+
+static void collect_block(const uint8_t block[], uint16_t size)
+{
+    memcpy(track + track_size, block, size);
+    track_size += size;
+}
+
+static void check(bool condition, const char *what, uint32_t index)
+{
+    if (!condition)
+    {
+        printf("FAIL %s (%lu)\n", what, (unsigned long)index);
+        failures++;
+    }
+}
+
+// Encodes the records, then checks every block header and column, and a set of range summaries against the records
+static void check_track(const char *name, const struct pitch_track_record records[], uint32_t count)
+{
+    track_size = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pitch_track_add(&records[i]);
+    }
+    pitch_track_flush();
+    printf("%s: %lu records, %lu bytes\n", name, (unsigned long)count, (unsigned long)track_size);
+
+    uint32_t offset = 0, first = 0;
+    const struct pitch_track_block_header *header;
+    while ((header = pitch_track_next_block(track, track_size, &offset)))
+    {
+        uint32_t expected_count = count - first < PITCH_TRACK_BLOCK_RECORDS ? count - first : PITCH_TRACK_BLOCK_RECORDS;
+        check(header->record_count == expected_count, "record count", first);
+
+        const struct pitch_track_record *block = &records[first];
+        struct pitch_track_record min = block[0], max = block[0];
+        uint32_t total_cost = 0;
+        for (uint16_t i = 0; i < header->record_count; i++)
+        {
+            min.pitch = block[i].pitch < min.pitch ? block[i].pitch : min.pitch;
+            max.pitch = block[i].pitch > max.pitch ? block[i].pitch : max.pitch;
+            min.confidence = block[i].confidence < min.confidence ? block[i].confidence : min.confidence;
+            max.confidence = block[i].confidence > max.confidence ? block[i].confidence : max.confidence;
+            min.cost = block[i].cost < min.cost ? block[i].cost : min.cost;
+            max.cost = block[i].cost > max.cost ? block[i].cost : max.cost;
+            total_cost += block[i].cost;
+        }
+        check(header->first_time_ms == block[0].time_ms, "first time", first);
+        check(header->last_time_ms == block[header->record_count - 1].time_ms, "last time", first);
+        check(header->min_pitch == min.pitch && header->max_pitch == max.pitch, "pitch range", first);
+        check(header->min_confidence == min.confidence && header->max_confidence == max.confidence, "confidence range", first);
+        check(header->min_cost == min.cost && header->max_cost == max.cost, "cost range", first);
+        check(header->total_cost == total_cost, "total cost", first);
+
+        int64_t values[PITCH_TRACK_COLUMNS][PITCH_TRACK_BLOCK_RECORDS];
+        for (uint8_t column = 0; column < PITCH_TRACK_COLUMNS; column++)
+        {
+            pitch_track_decode_column(header, column, values[column]);
+        }
+        for (uint16_t i = 0; i < header->record_count; i++)
+        {
+            check(values[PITCH_TRACK_TIME][i] == block[i].time_ms, "time", first + i);
+            check(values[PITCH_TRACK_PITCH][i] == block[i].pitch, "pitch", first + i);
+            check(values[PITCH_TRACK_CONFIDENCE][i] == block[i].confidence, "confidence", first + i);
+            check(values[PITCH_TRACK_COST][i] == block[i].cost, "cost", first + i);
+        }
+        first += header->record_count;
+    }
+    check(first == count && offset == track_size, "records decoded", first);
+    if (count == 0)
+        return;
+
+    // Whole track, ranges within single blocks, and ranges crossing the block boundaries
+    uint32_t bounds[][2] = {
+        {0, UINT32_MAX},
+        {records[0].time_ms, records[count - 1].time_ms},
+        {records[count / 3].time_ms, records[count / 2].time_ms},
+        {records[count / 2].time_ms + 1, records[count - 1].time_ms - 1},
+        {records[count - 1].time_ms, records[count - 1].time_ms},
+    };
+    for (uint8_t range = 0; range < sizeof(bounds) / sizeof(bounds[0]); range++)
+    {
+        struct pitch_track_summary summary, expected = {0, INT32_MAX, INT32_MIN, 0};
+        pitch_track_summarize(track, track_size, bounds[range][0], bounds[range][1], &summary);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (records[i].time_ms < bounds[range][0] || records[i].time_ms > bounds[range][1])
+                continue;
+            expected.record_count++;
+            expected.total_cost += records[i].cost;
+            expected.min_pitch = records[i].pitch < expected.min_pitch ? records[i].pitch : expected.min_pitch;
+            expected.max_pitch = records[i].pitch > expected.max_pitch ? records[i].pitch : expected.max_pitch;
+        }
+        check(summary.record_count == expected.record_count, "summary count", range);
+        check(summary.total_cost == expected.total_cost, "summary cost", range);
+        check(summary.min_pitch == expected.min_pitch && summary.max_pitch == expected.max_pitch, "summary pitch", range);
+    }
+}
+
+int main()
+{
+    static struct pitch_track_record records[RECORD_COUNT];
+    pitch_track_output = collect_block;
+
+    // Realistic results, the last block is partial
+    srand(1);
+    uint32_t time_ms = 1000;
+    for (uint32_t i = 0; i < RECORD_COUNT; i++)
+    {
+        time_ms += 20 + rand() % 40;
+        records[i] = (struct pitch_track_record){
+            .time_ms = time_ms,
+            .pitch = pitch_track_pitch(40 + rand() % 1000),
+            .confidence = rand() % PEAK_TRACKING_LIMIT,
+            .cost = 1000000 + rand() % 5000000,
+        };
+    }
+    check_track("random", records, RECORD_COUNT);
+
+    // Full width values of every column, in a single partial block
+    records[0] = (struct pitch_track_record){0, INT32_MIN, 0, 0};
+    records[1] = (struct pitch_track_record){UINT32_MAX, INT32_MAX, UINT8_MAX, UINT32_MAX};
+    check_track("full width", records, 2);
+    const struct pitch_track_block_header *header = (const struct pitch_track_block_header *)track;
+    for (uint8_t column = 0; column < PITCH_TRACK_COLUMNS; column++)
+    {
+        check(header->widths[column] == (column == PITCH_TRACK_CONFIDENCE ? 8 : 32), "full width", column);
+    }
+
+    // A single record, and nothing to flush
+    check_track("single record", records, 1);
+    check_track("empty", records, 0);
+    check(track_size == 0, "empty track", 0);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures != 0;
+}
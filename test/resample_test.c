@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "macros.h"
+
+// The resampler is compiled for the ADC sampling frequency under test, see CMakeLists.txt
+#undef ADC_FS
+#define ADC_FS TEST_ADC_FS
+#include "freq_analysis.c"
+
+// Truncation of the output, and the quantization of the phase and the step, in output LSBs
+#define TOLERANCE 1.25
+
+static int failures = 0;
+
+/**
+ * @brief Double precision reference of resample_samples.
+ *
+ * Output i lies at ADC sample position i * ADC_FS / FS. It is linearly interpolated between the SMA windows
+ * starting at the two ADC samples around that position.
+ */
+static double reference_sample(uint8_t src[], uint16_t i)
+{
+    double position = (double)i * ADC_FS / FS;
+    uint16_t index = (uint16_t)position;
+    double fraction = position - index;
+
+    double sum = 0, next_sum = 0;
+    for (uint8_t j = 0; j <= SMA_WIDTH; j++)
+    {
+        sum += src[index + j];
+        next_sum += src[index + j + 1];
+    }
+    return ((1 - fraction) * sum + fraction * next_sum) / (SMA_WIDTH + 1);
+}
+
+static void check_buffer(const char *name, uint8_t input[], uint16_t num_samples)
+{
+    uint8_t output[NUM_SAMPLES];
+    resample_samples(output, input, num_samples, NULL);
+
+    double max_error = 0;
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        double error = output[i] - reference_sample(input, i);
+        if (fabs(error) > fabs(max_error))
+            max_error = error;
+    }
+    if (fabs(max_error) > TOLERANCE)
+    {
+        printf("FAIL %s: max error %.3f\n", name, max_error);
+        failures++;
+    }
+}
+
+int main()
+{
+    uint8_t input[CAPTURE_LENGTH(NUM_SAMPLES)];
+
+    memset(input, 0, sizeof(input));
+    check_buffer("all 0", input, NUM_SAMPLES);
+
+    memset(input, 255, sizeof(input));
+    check_buffer("all 255", input, NUM_SAMPLES);
+
+    // Full scale steps between the two windows of each output
+    for (uint16_t i = 0; i < sizeof(input); i++)
+    {
+        input[i] = (i / (SMA_WIDTH + 1)) % 2 ? 255 : 0;
+    }
+    check_buffer("square", input, NUM_SAMPLES);
+
+    for (uint16_t i = 0; i < sizeof(input); i++)
+    {
+        input[i] = 128 + 100 * sin(2 * M_PI * 440 * i / ADC_FS);
+    }
+    check_buffer("sine", input, NUM_SAMPLES);
+
+    srand(1);
+    for (uint8_t round = 0; round < 100; round++)
+    {
+        for (uint16_t i = 0; i < sizeof(input); i++)
+        {
+            input[i] = rand() & 0xff;
+        }
+        check_buffer("random", input, NUM_SAMPLES);
+    }
+
+    printf("ADC_FS %u: %s\n", ADC_FS, failures ? "FAILED" : "PASSED");
+    return failures != 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include "freq_analysis.h"
+
+#define BUFFER_LENGTH (NUM_SAMPLES + SMA_WIDTH)
+
+static int failures = 0;
+
+/**
+ * @brief Model of lane 0 of the interpolator, as configured by init_interp and used by copy_smoothed_samples.
+ *
+ * The accumulator wraps at 32 bits, and the raw result is the accumulator shifted by SMA_RECIPROCAL_SHIFT
+ * and masked to bits 0-7.
+ */
+static void smooth_samples_interp(uint8_t dst[], uint8_t src[], uint16_t num_samples)
+{
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i <= SMA_WIDTH; i++)
+    {
+        sum += src[i];
+    }
+    uint32_t accumulator = sum * SMA_RECIPROCAL;
+
+    uint8_t leaving = src[0];
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        if (i > 0)
+        {
+            accumulator += (uint32_t)((src[i + SMA_WIDTH] - leaving) * (int32_t)SMA_RECIPROCAL);
+            leaving = src[i];
+        }
+        dst[i] = (accumulator >> SMA_RECIPROCAL_SHIFT) & 0xff;
+    }
+}
+
+static void check(const char *name, const char *variant, uint8_t output[], uint8_t input[], uint16_t num_samples)
+{
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        uint16_t expected = calculate_sma(i, input);
+        if (output[i] != expected)
+        {
+            printf("FAIL %s %s: sample %u is %u, calculate_sma gives %u\n", name, variant, i, output[i], expected);
+            failures++;
+            return;
+        }
+    }
+}
+
+static void check_buffer(const char *name, uint8_t input[], uint16_t num_samples)
+{
+    uint8_t output[BUFFER_LENGTH];
+
+    smooth_samples(output, input, num_samples, NULL);
+    check(name, "smooth_samples", output, input, num_samples);
+
+    memcpy(output, input, BUFFER_LENGTH);
+    smooth_samples(output, output, num_samples, NULL);
+    check(name, "smooth_samples in place", output, input, num_samples);
+
+    smooth_samples_interp(output, input, num_samples);
+    check(name, "interpolator", output, input, num_samples);
+
+    memcpy(output, input, BUFFER_LENGTH);
+    smooth_samples_interp(output, output, num_samples);
+    check(name, "interpolator in place", output, input, num_samples);
+}
+
+int main()
+{
+    uint8_t input[BUFFER_LENGTH];
+
+    memset(input, 0, sizeof(input));
+    check_buffer("all 0", input, NUM_SAMPLES);
+
+    memset(input, 255, sizeof(input));
+    check_buffer("all 255", input, NUM_SAMPLES);
+
+    // Sums one below, at and one above each multiple of the SMA width, the rounding boundaries of the reciprocal
+    for (uint16_t i = 0; i < BUFFER_LENGTH; i++)
+    {
+        input[i] = (i % (SMA_WIDTH + 1)) == 0 ? 255 : 0;
+    }
+    check_buffer("single 255 per window", input, NUM_SAMPLES);
+    for (uint16_t i = 0; i < BUFFER_LENGTH; i++)
+    {
+        input[i] = (i % (SMA_WIDTH + 1)) == 0 ? 254 : 255;
+    }
+    check_buffer("single 254 per window", input, NUM_SAMPLES);
+
+    // Windows reaching the last sample of the buffer, and the shortest input
+    memset(input, 0, sizeof(input));
+    input[BUFFER_LENGTH - 1] = 255;
+    check_buffer("last sample", input, NUM_SAMPLES);
+    check_buffer("single window", input, 1);
+
+    srand(1);
+    for (uint8_t round = 0; round < 100; round++)
+    {
+        for (uint16_t i = 0; i < BUFFER_LENGTH; i++)
+        {
+            input[i] = rand() & 0xff;
+        }
+        check_buffer("random", input, NUM_SAMPLES);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures != 0;
+}
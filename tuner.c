@@ -41,25 +41,86 @@
  * 
  */
 
+#include <math.h>
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 #include "hardware/dma.h"
 #include "hardware/adc.h"
 #include "hardware/irq.h"
+#include "hardware/interp.h"
+#include "hardware/sync.h"
 
 #include "macros.h"
 #include "freq_analysis.h"
+#include "stats.h"
+#include "calibration.h"
+#include "profile.h"
+#include "pitch_tracker.h"
+#include "lag_priors.h"
+#include "perf_counters.h"
+#include "shadow.h"
+#include "pitch_track.h"
 
 // DMA channels for ADC
 uint8_t sample_channel = 0;
 uint8_t control_channel = 1; // resetting write_addr of sample_channel
 
+// ADC flags and the time latched by capture_complete_handler when the sample channel finishes a capture.
+// The ADC keeps converting afterwards, so its FIFO overflows until the channel is restarted, which is not an error.
+volatile bool capture_complete = false;
+volatile bool capture_adc_overflow = false;
+volatile bool capture_adc_error = false;
+volatile uint32_t capture_complete_time;
+
+// Hardware alarm of the core 1 alarm pool, refreshing the display with DISPLAY_REFRESH_IRQ
+uint8_t display_refresh_alarm = 1;
+
 // Destination for DMA to transfer samples from ADC
-// The size is incremented by SMA_WIDTH to provide extra samples for Simple Moving Average (SMA) smoothing
-uint8_t samples_buff[NUM_SAMPLES + SMA_WIDTH];
+// The size is incremented by SMA_WIDTH to provide extra samples for Simple Moving Average (SMA) smoothing,
+// and scaled by ADC_FS / FS if the samples are resampled
+#if SMOOTH_IN_PLACE
+#if ADC_FS < FS
+#error "SMOOTH_IN_PLACE requires ADC_FS not lower than FS"
+#endif
+// The DMA fills one buffer, while the other one is smoothed in place and analyzed
+uint8_t samples_buff[2][CAPTURE_LENGTH(NUM_SAMPLES)];
+
+// Pointer to the sample buffer being filled
+uint8_t *samples_buff_ptr = samples_buff[0];
+#else
+uint8_t samples_buff[CAPTURE_LENGTH(NUM_SAMPLES)];
 
 // Pointer to the sample buffer
 uint8_t *samples_buff_ptr = &samples_buff[0];
+#endif
+
+// Preconditioning applied while smoothing
+struct preconditioning preconditioning;
+
+// Tracker extrapolating the frequency between the results, used by core 1
+struct pitch_tracker pitch_tracker;
+
+// Time the next predictive display refresh is due, used by core 1
+uint32_t next_refresh_time;
+
+// Set by core 0 to stop core 1 while the flash is being programmed
+volatile bool core1_park_request = false;
+volatile bool core1_parked = false;
+
+// Set once the flash has been programmed, the capture in progress meanwhile overflowed the ADC FIFO only after its end
+bool flash_write_spanned_capture = false;
+
+#if SINGLE_CORE && SHADOW_MODE
+#error "SHADOW_MODE requires core 1, it can not be used with SINGLE_CORE"
+#endif
+
+#if SHADOW_MODE
+// The shadow engine runs on core 1, its working arrays exceed the default core 1 stack
+uint32_t core1_stack[SHADOW_STACK_SIZE / sizeof(uint32_t)];
+#endif
+
+// Instrument profile used for the capture in progress
+enum profile_id captured_profile = DEFAULT_PROFILE;
 
 // Union to push float through FIFO
 union frequency_union
@@ -68,45 +129,451 @@ union frequency_union
     uint32_t i;
 };
 
+// Flags passed to core 1 along with each calculated frequency
+#define RESULT_FLAG_DISCONTINUOUS 0b00000001 // Samples were lost or corrupted during the capture of the analyzed frame
+#define RESULT_FLAG_PROVISIONAL 0b00000010   // Estimated from the beginning of the capture, the full analysis follows
+
+// The provisional analysis is the short window analysis of calculate_freq_harmonic_locked, so its result is passed on
+#define PROVISIONAL_IS_SHORT_WINDOW (DUAL_WINDOW && PROVISIONAL_WINDOW_DIVIDER == HARMONIC_LOCK_WINDOW_DIVIDER && \
+                                     PROVISIONAL_THRESHOLD_DIVIDER == HARMONIC_LOCK_THRESHOLD_DIVIDER)
+
+// Defined with the display functions, called by core 0 with SINGLE_CORE
+void handle_result(uint32_t result_flags, float frequency);
+void service_tasks();
+
+/**
+ * @brief Check ADC Errors Function
+ *
+ * This function checks the sticky ADC flags latched at the end of the last capture, and updates the counters.
+ * The FIFO overflow flag indicates that the DMA did not keep up and at least one sample is missing from the frame.
+ * Overflows after the end of the capture (while core 0 is late for the restart) do not affect the frame.
+ * Neither do those latched for the capture spanning a flash write: the DMA kept transferring, but the interrupts were
+ * disabled, so the completion was handled late.
+ * The error flag indicates a failed conversion. Note that the per-sample error bit (adc_fifo_setup) is not usable here,
+ * as the samples are shifted to 8 bits and transferred by 8-bit DMA.
+ *
+ * @return true if the captured samples can not be considered continuous.
+ */
+bool check_adc_errors()
+{
+    bool discontinuous = false;
+
+    if (flash_write_spanned_capture)
+    {
+        flash_write_spanned_capture = false;
+        capture_adc_overflow = false;
+    }
+    if (capture_adc_overflow)
+    {
+        stats.adc_fifo_overflows++;
+        discontinuous = true;
+    }
+    if (capture_adc_error)
+    {
+        stats.adc_errors++;
+        discontinuous = true;
+    }
+
+    return discontinuous;
+}
+
+/**
+ * @brief Capture Complete Interrupt Handler Function
+ *
+ * This function runs on core 0 when the sample channel has transferred the whole capture. It latches the sticky
+ * ADC flags and the time right away, before the free-running ADC overflows its FIFO, so check_adc_errors only
+ * reports the overruns that happened during the transfer, and the restart gap is measured from the actual end.
+ */
+void capture_complete_handler()
+{
+    dma_channel_acknowledge_irq0(sample_channel);
+    capture_complete_time = time_us_32();
+    capture_adc_overflow = adc_hw->fcs & ADC_FCS_OVER_BITS;
+    capture_adc_error = adc_hw->cs & ADC_CS_ERR_STICKY_BITS;
+    capture_complete = true;
+}
+
+/**
+ * @brief Restart Sampling Function
+ *
+ * This function restarts the sample DMA channel (through the control channel), capturing the number of samples
+ * required by the active profile, so that narrower profiles also shorten the acquisition.
+ * Conversions completed while the DMA was stopped are dropped, so that the next frame starts with fresh samples,
+ * and the flags raised by the overflowing FIFO in the meantime are cleared.
+ * With SMOOTH_IN_PLACE, the capture goes to the other buffer.
+ */
+void restart_sampling()
+{
+    adc_fifo_drain();
+    // The flags are write-1-to-clear
+    hw_set_bits(&adc_hw->fcs, ADC_FCS_OVER_BITS | ADC_FCS_UNDER_BITS);
+    hw_set_bits(&adc_hw->cs, ADC_CS_ERR_STICKY_BITS);
+    capture_complete = false;
+    captured_profile = active_profile;
+#if SMOOTH_IN_PLACE
+    samples_buff_ptr = samples_buff_ptr == samples_buff[0] ? samples_buff[1] : samples_buff[0];
+#endif
+    dma_channel_set_trans_count(sample_channel, CAPTURE_LENGTH(profiles[captured_profile].num_samples), false);
+    dma_channel_start(control_channel);
+}
+
+/**
+ * @brief Copy Smoothed Samples Function
+ *
+ * This function copies captured samples, applying Simple Moving Average (SMA) smoothing.
+ * The destination may be the source buffer itself, then the samples are smoothed in place.
+ * With SMA_USE_INTERP, lane 0 of the calling core's interpolator 0 accumulates the running sum scaled by SMA_RECIPROCAL,
+ * and its shift and mask yield the average, so the output is identical to smooth_samples (and calculate_sma).
+ * The preconditioning selected by PRECONDITIONING is applied in the same pass.
+ * If ADC_FS differs from FS, resample_samples produces the samples at FS instead.
+ *
+ * @param samples The destination array.
+ * @param captured The buffer holding the captured samples.
+ * @param num_samples The number of samples to copy.
+ * @param pre Pointer to the preconditioning state, carrying the peak amplitude of the previous frame,
+ *            or NULL to copy the smoothed samples unconditioned.
+ */
+void copy_smoothed_samples(uint8_t samples[], uint8_t captured[], uint16_t num_samples, struct preconditioning *pre)
+{
+    if (pre)
+        update_preconditioning(pre, calibration.dc_bias);
+
+#if ADC_FS != FS
+    resample_samples(samples, captured, num_samples, pre);
+#elif SMA_USE_INTERP
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i <= SMA_WIDTH; i++)
+    {
+        sum += captured[i];
+    }
+    interp_set_accumulator(interp0, 0, sum * SMA_RECIPROCAL);
+
+    // The sample leaving the sum may have been overwritten by the previous output
+    uint8_t leaving = captured[0];
+    for (uint16_t i = 0; i < num_samples; i++)
+    {
+        if (i > 0)
+        {
+            interp_add_accumulater(interp0, 0, (captured[i + SMA_WIDTH] - leaving) * SMA_RECIPROCAL);
+            leaving = captured[i];
+        }
+        samples[i] = interp_get_raw(interp0, 0);
+#if PRECONDITIONING != PRECONDITIONING_NONE
+        if (pre)
+            samples[i] = precondition_sample(samples[i], pre);
+#endif
+    }
+#else
+    smooth_samples(samples, captured, num_samples, pre);
+#endif
+}
+
+/**
+ * @brief Below Noise Gate Function
+ *
+ * This function checks whether the power of the smoothed samples falls below the calibrated noise gate.
+ * The gate is calibrated over NUM_SAMPLES, so it is scaled to the window length.
+ *
+ * @param samples The smoothed samples.
+ * @param num_samples The number of samples.
+ * @param pre Pointer to the preconditioning state the samples were smoothed with.
+ *
+ * @return true if the samples should not be analyzed.
+ */
+bool below_noise_gate(uint8_t samples[], uint16_t num_samples, struct preconditioning *pre)
+{
+#if PRECONDITIONING != PRECONDITIONING_NONE
+    uint32_t signal_pwr = pre->signal_pwr; // Measured before preconditioning
+#else
+    (void)pre;
+    uint32_t signal_pwr = calculate_signal_pwr(samples, num_samples, calibration.dc_bias);
+#endif
+    return signal_pwr < calibration_gate_threshold(num_samples);
+}
+
+/**
+ * @brief Publish Result Function
+ *
+ * This function passes the result flags and the calculated frequency to core 1 through the multicore FIFO.
+ * With SINGLE_CORE, the result is handled right away instead.
+ *
+ * @param result_flags The RESULT_FLAG_* bits describing the result.
+ * @param frequency The calculated frequency.
+ */
+void publish_result(uint32_t result_flags, float frequency)
+{
+#if SINGLE_CORE
+    handle_result(result_flags, frequency);
+#else
+    union frequency_union frequency_union;
+    frequency_union.f = frequency;
+    if (!multicore_fifo_wready())
+        stats.handoff_stalls++;
+    multicore_fifo_push_blocking(result_flags);
+    multicore_fifo_push_blocking(frequency_union.i);
+#endif
+}
+
+/**
+ * @brief Analyze Provisional Window Function
+ *
+ * This function waits until the beginning of the capture in progress has been transferred by the DMA,
+ * and estimates the frequency from it, using the active profile's window and shift limit divided by
+ * PROVISIONAL_WINDOW_DIVIDER, and always the interference engine, as the cheapest one.
+ * The interference threshold is tightened by PROVISIONAL_THRESHOLD_DIVIDER for the time of the analysis.
+ * If a peak is found, the result is published as provisional right away, ahead of the full analysis.
+ * Periods longer than the shortened shift limit cannot be found, those notes wait for the full analysis.
+ *
+ * @param peak_count Pointer to the variable receiving the number of identified peaks (0 if none was found).
+ *
+ * @return The provisional frequency, or 0 if the beginning of the capture is below the noise gate.
+ */
+float analyze_provisional_window(uint8_t *peak_count)
+{
+    uint8_t samples[NUM_SAMPLES / PROVISIONAL_WINDOW_DIVIDER];
+    const struct analysis_profile *profile = &profiles[captured_profile];
+    uint16_t num_samples = profile->num_samples / PROVISIONAL_WINDOW_DIVIDER;
+    uint16_t shift_limit = profile->shift_limit / PROVISIONAL_WINDOW_DIVIDER;
+
+    // The write address of the sample channel points past the last transferred sample.
+    // The control channel sets it back to the buffer start right after restart_sampling, long before this is called.
+    uint32_t capture_length = CAPTURE_LENGTH(num_samples);
+    while (dma_hw->ch[sample_channel].write_addr - (uint32_t)samples_buff_ptr < capture_length)
+        service_tasks();
+
+    struct perf_snapshot perf;
+    perf_begin(&perf);
+
+    // The preconditioning state is copied, so the full frame is preconditioned with the previous frame's peak
+    struct preconditioning provisional_preconditioning = preconditioning;
+    copy_smoothed_samples(samples, samples_buff_ptr, num_samples, &provisional_preconditioning);
+
+    *peak_count = 0;
+    float frequency = 0;
+    if (!below_noise_gate(samples, num_samples, &provisional_preconditioning))
+    {
+        // Counted apart, as the cycles of the provisional analysis are not a part of the analysis stage
+        uint64_t accumulated = accumulated_samples[0];
+        frequency = calculate_freq_with_threshold(samples, num_samples, shift_limit, peak_count,
+                                                  interference_threshold / PROVISIONAL_THRESHOLD_DIVIDER);
+        stats.provisional_samples += accumulated_samples[0] - accumulated;
+    }
+    perf_end(&perf, PERF_STAGE_PROVISIONAL);
+
+    if (*peak_count > 0)
+    {
+        stats.provisional_results++;
+        publish_result(RESULT_FLAG_PROVISIONAL, frequency);
+    }
+    return frequency;
+}
+
+/**
+ * @brief Calibrate Function
+ *
+ * This function loads the unit calibration from flash. If there is none (first power-up, or FORCE_CALIBRATION set),
+ * DC bias and noise floor are measured over CALIBRATION_FRAMES frames, assuming there is no input signal,
+ * and the result is stored in flash, so next power-ups start with the thresholds matching the mic/preamp in use.
+ * Must be called before core 1 is launched, as no code can be executed from flash while it is being programmed.
+ */
+void calibrate()
+{
+    if (!FORCE_CALIBRATION && load_calibration())
+        return;
+
+    uint8_t samples[NUM_SAMPLES];
+    calibration_begin();
+    for (uint8_t frame = 0; frame < CALIBRATION_FRAMES; frame++)
+    {
+        while (!capture_complete)
+            tight_loop_contents();
+        uint16_t num_samples = profiles[captured_profile].num_samples;
+        check_adc_errors();
+        // The noise is measured on the raw smoothed signal, the preconditioning would quantise or shrink it
+        copy_smoothed_samples(samples, samples_buff_ptr, num_samples, NULL);
+        restart_sampling();
+        calibration_add_frame(samples, num_samples);
+    }
+
+    if (calibration_finish())
+        store_calibration();
+    else
+        printf("Calibration rejected, the input was not quiet\n");
+}
+
+/**
+ * @brief Store Lag Priors Function
+ *
+ * This function stores the histogram of detected periods in flash. No code can be executed from flash while it is
+ * being programmed, so core 1 is parked in RAM for that time (with SINGLE_CORE, there is nothing to park).
+ * The display is not refreshed for a few tens of milliseconds.
+ * Core 1 responds to the request between its tasks, and between the analysis slices of the shadow engine.
+ * The capture in progress, if any, is marked, so its late completion is not counted as an overflow.
+ */
+void store_lag_priors_parked()
+{
+    bool capture_in_progress = !capture_complete;
+#if SINGLE_CORE
+    store_lag_priors();
+#else
+    core1_park_request = true;
+    while (!core1_parked)
+        tight_loop_contents();
+
+    store_lag_priors();
+
+    core1_park_request = false;
+#endif
+    flash_write_spanned_capture = capture_in_progress;
+}
+
 /**
  * @brief Core 0 Thread Function
  *
  * This function runs on Core 0 and continuously performs the following tasks:
  *
- * 1. Waits for samples from an ADC using DMA.
+ * 1. Waits for samples from an ADC using DMA, and checks whether any of them were lost.
+ *    With DUAL_WINDOW, the beginning of the capture is analyzed while the rest is being acquired,
+ *    and the provisional result is passed to Core 1 right away.
  * 2. Copies the samples from the buffer, applying Simple Moving Average (SMA) smoothing.
  * 3. Restarts the sample DMA channel, allowing collection of the next sample set.
- * 4. Calculates the base frequency of the input signal using the smoothed samples.
- * 5. Passes the calculated frequency to Core 1 using the multicore FIFO.
+ *    With SMOOTH_IN_PLACE, the next set is collected into the other buffer, so the channel is restarted first,
+ *    and the captured buffer is smoothed in place and analyzed directly, without a copy.
+ * 4. Skips the frame if its power does not exceed the calibrated noise gate.
+ * 5. Calculates the base frequency of the input signal using the smoothed samples, and updates the instrument profile.
+ *    Confident results are recorded in the lag priors, which are periodically stored in flash.
+ * 6. Passes the result flags and the calculated frequency to Core 1 using the multicore FIFO.
+ * 7. With PITCH_TRACK, records the result in the pitch track printed to the console.
+ *    With SHADOW_MODE, submits a sample of the frames to the shadow engine on Core 1.
+ * 8. Periodically prints the acquisition counters. With METRICS_ENDPOINT, they are also printed on request.
+ *    With SOAK_MONITOR, the time of each frame is recorded, and whether the next capture completed before it ended.
  *
  * The function operates in an infinite loop, ensuring continuous processing of incoming samples.
  */
 void core0_thread()
 {
     float frequency;
+    uint8_t peak_count;
+#if !SMOOTH_IN_PLACE
     uint8_t samples[NUM_SAMPLES];
+#endif
 
+    uint32_t capture_end_time = 0;
     while (1)
     {
+#if SOAK_MONITOR
+        // The next capture should still be in progress, otherwise core 0 missed its deadline and samples were lost
+        if (capture_end_time)
+            stats_record_frame_time(time_us_32() - capture_end_time, capture_complete);
+#endif
+
+        float provisional_frequency = 0;
+        uint8_t provisional_peak_count = 0;
+#if DUAL_WINDOW
+        provisional_frequency = analyze_provisional_window(&provisional_peak_count);
+#endif
+
+#if METRICS_ENDPOINT
+        // Answer a metrics request while the capture is in progress
+        if (getchar_timeout_us(0) == METRICS_REQUEST)
+            print_metrics(time_us_64());
+#endif
+
         // Wait for samples from ADC
-        dma_channel_wait_for_finish_blocking(sample_channel);
+        while (!capture_complete)
+            service_tasks();
+        capture_end_time = capture_complete_time;
 
-        // Copy samples from sampes_buff, applying SMA smoothing
-        for (uint16_t i = 0; i < NUM_SAMPLES; i++)
+        // The frame was captured with the profile active when sampling was restarted
+        enum profile_id profile = captured_profile;
+        uint16_t num_samples = profiles[profile].num_samples;
+
+        uint32_t result_flags = 0;
+        if (check_adc_errors())
         {
-            samples[i] = calculate_sma(i, samples_buff);
+            stats.discontinuous_frames++;
+            result_flags |= RESULT_FLAG_DISCONTINUOUS;
         }
 
+        struct perf_snapshot perf;
+#if SMOOTH_IN_PLACE
+        // Restart the sample channel into the other buffer, and smooth the captured one in place
+        uint8_t *samples = samples_buff_ptr;
+        restart_sampling();
+        stats_record_restart_gap((time_us_32() - capture_end_time) * (ADC_FS / 1000) / 1000);
+
+        perf_begin(&perf);
+        copy_smoothed_samples(samples, samples, num_samples, &preconditioning);
+        perf_end(&perf, PERF_STAGE_SMOOTHING);
+#else
+        // Copy samples from sampes_buff, applying SMA smoothing
+        perf_begin(&perf);
+        copy_smoothed_samples(samples, samples_buff, num_samples, &preconditioning);
+        perf_end(&perf, PERF_STAGE_SMOOTHING);
+
         // Restart the sample channel, samples_buff can be overwritten
-        dma_channel_start(control_channel);
+        restart_sampling();
+        stats_record_restart_gap((time_us_32() - capture_end_time) * (ADC_FS / 1000) / 1000);
+#endif
+
+        // Don't analyze noise, the display holds the previous reading
+        perf_begin(&perf);
+        bool gated = below_noise_gate(samples, num_samples, &preconditioning);
+        perf_end(&perf, PERF_STAGE_GATE);
+        if (gated)
+        {
+            stats.gated_frames++;
+            continue;
+        }
 
         // Calculate the base freq of the input signal
-        frequency = calculate_freq(samples);
+#if PITCH_TRACK
+        uint64_t analysis_cycles = stats.stages[PERF_STAGE_ANALYSIS].cycles;
+#endif
+        uint32_t analysis_start_time = time_us_32();
+        perf_begin(&perf);
+#if FREQ_ENGINE != ENGINE_INTERFERENCE
+        frequency = freq_engines[FREQ_ENGINE](samples, num_samples, profiles[profile].shift_limit, &peak_count);
+#else
+        if (HARMONIC_LOCK && profiles[profile].lowest_freq < HARMONIC_LOCK_MAX_FREQ)
+            frequency = calculate_freq_harmonic_locked(samples, num_samples, profiles[profile].shift_limit, &peak_count,
+                                                       PROVISIONAL_IS_SHORT_WINDOW ? provisional_frequency : 0,
+                                                       provisional_peak_count);
+        else
+            frequency = calculate_freq(samples, num_samples, profiles[profile].shift_limit, &peak_count);
+#endif
+        perf_end(&perf, PERF_STAGE_ANALYSIS);
+        stats_record_analysis_time(time_us_32() - analysis_start_time);
+        stats.profile_frames[profile]++;
+        update_profile(frequency, peak_count);
 
-        // Pass calculated freq to core_1 and start over
-        union frequency_union frequency_union;
-        frequency_union.f = frequency;
-        multicore_fifo_push_blocking(frequency_union.i);
+        if (peak_count >= MIN_CONFIDENT_PEAKS)
+        {
+            record_lag_prior(FS / frequency);
+            if (lag_priors_save_due())
+                store_lag_priors_parked();
+        }
+
+        // Pass the flags and calculated freq to core_1 and start over
+        perf_begin(&perf);
+        publish_result(result_flags, frequency);
+        perf_end(&perf, PERF_STAGE_HANDOFF);
+
+#if PITCH_TRACK
+        pitch_track_add(&(struct pitch_track_record){
+            .time_ms = time_us_64() / 1000,
+            .pitch = pitch_track_pitch(frequency),
+            .confidence = peak_count,
+            .cost = stats.stages[PERF_STAGE_ANALYSIS].cycles - analysis_cycles,
+        });
+#endif
+
+#if SHADOW_MODE
+        shadow_submit(samples, num_samples, profiles[profile].shift_limit, frequency, peak_count);
+#endif
+
+        if (++stats.frames % STATS_REPORT_INTERVAL == 0)
+            print_stats(time_us_32());
     }
 }
 
@@ -164,93 +631,248 @@ void update_leds(float frequency, float refference_frequency)
     }
 }
 
+/**
+ * @brief Display Frequency Function
+ *
+ * This function normalizes the frequency to a single octave, and presents the closest note on the display,
+ * and the deviation from it on the LEDs.
+ *
+ * @param frequency The frequency to present.
+ */
+void display_frequency(float frequency)
+{
+    // Normalize received frequency to fit described range.
+    // Division/Multiplication by 2 changes the octave, so for example C4 note will be changed to C3
+    while (frequency < A3_bottom_range)
+        frequency *= 2;
+    while (frequency > A4_bottom_range)
+        frequency /= 2;
+
+    // Fit the frequewncy to the proper range and update output
+    if (frequency > A3_bottom_range && frequency < A3_sharp_bottom_range)
+    {
+        update_display(A_note);
+        update_leds(frequency, A3_freq);
+    }
+    else if (frequency > A3_sharp_bottom_range && frequency < B3_bottom_range)
+    {
+        update_display(A_sharp_note);
+        update_leds(frequency, A3_sharp_freq);
+    }
+    else if (frequency > B3_bottom_range && frequency < C3_bottom_range)
+    {
+        update_display(B_note);
+        update_leds(frequency, B3_freq);
+    }
+    else if (frequency > C3_bottom_range && frequency < C3_sharp_bottom_range)
+    {
+        update_display(C_note);
+        update_leds(frequency, C3_freq);
+    }
+    else if (frequency > C3_sharp_bottom_range && frequency < D3_bottom_range)
+    {
+        update_display(C_sharp_note);
+        update_leds(frequency, C3_sharp_freq);
+    }
+    else if (frequency > D3_bottom_range && frequency < D3_sharp_bottom_range)
+    {
+        update_display(D_note);
+        update_leds(frequency, D3_freq);
+    }
+    else if (frequency > D3_sharp_bottom_range && frequency < E3_bottom_range)
+    {
+        update_display(D_sharp_note);
+        update_leds(frequency, D3_sharp_freq);
+    }
+    else if (frequency > E3_bottom_range && frequency < F3_bottom_range)
+    {
+        update_display(E_note);
+        update_leds(frequency, E3_freq);
+    }
+    else if (frequency > F3_bottom_range && frequency < F3_sharp_bottom_range)
+    {
+        update_display(F_note);
+        update_leds(frequency, F3_freq);
+    }
+    else if (frequency > F3_sharp_bottom_range && frequency < G3_bottom_range)
+    {
+        update_display(F_sharp_note);
+        update_leds(frequency, F3_sharp_freq);
+    }
+    else if (frequency > G3_bottom_range && frequency < G3_sharp_bottom_range)
+    {
+        update_display(G_note);
+        update_leds(frequency, G3_freq);
+    }
+    else if (frequency > G3_sharp_bottom_range && frequency < A4_bottom_range)
+    {
+        update_display(G_sharp_note);
+        update_leds(frequency, G3_sharp_freq);
+    }
+}
+
+/**
+ * @brief Print Result Function
+ *
+ * This function prints a frequency received by Core 1 to the console. The print is skipped while Core 0 prints
+ * the metrics response, so the response is not interleaved.
+ *
+ * @param frequency The received frequency.
+ * @param suffix Text describing the kind of the result, appended to the frequency.
+ */
+void print_result(float frequency, const char *suffix)
+{
+    if (!console_try_lock())
+        return;
+    printf("\nCore_1: %fHz%s\n", frequency, suffix);
+    console_unlock();
+}
+
+/**
+ * @brief Display Provisional Frequency Function
+ *
+ * This function presents the note of a provisional result, with all LEDs off, as its deviation is not accurate enough.
+ * A provisional result agreeing with the tracked frequency (within a quarter tone) is ignored, so a held note
+ * does not flicker. Otherwise a new note has started, and the tracker is reset, so the predictive refresh does not
+ * bring the previous note back before the refined result arrives.
+ *
+ * @param frequency The provisional frequency.
+ */
+void display_provisional_frequency(float frequency)
+{
+    float tracked_frequency = predict_pitch(&pitch_tracker, time_us_32());
+    if (tracked_frequency > 0 && fabsf(frequency - tracked_frequency) < tracked_frequency / 34)
+        return;
+
+    print_result(frequency, " (provisional)");
+    pitch_tracker = (struct pitch_tracker){0};
+    display_frequency(frequency);
+    gpio_put(LOW_PITCH_INDICATOR_PIN, 0);
+    gpio_put(IN_TUNE_INDICATOR_PIN, 0);
+    gpio_put(HI_PITCH_INDICATOR_PIN, 0);
+}
+
+/**
+ * @brief Handle Result Function
+ *
+ * This function processes a frequency calculated by Core 0, updating the display, and controlling LEDs.
+ * Frequencies calculated from discontinuous samples are only printed, the display holds the previous reading.
+ * Provisional frequencies only present the note, until the refined result of the same frame arrives.
+ *
+ * @param result_flags The RESULT_FLAG_* bits describing the result.
+ * @param frequency The calculated frequency.
+ */
+void handle_result(uint32_t result_flags, float frequency)
+{
+    //Print receiver freq to console
+    if (result_flags & RESULT_FLAG_DISCONTINUOUS)
+    {
+        print_result(frequency, " (discontinuous)");
+        return;
+    }
+    if (result_flags & RESULT_FLAG_PROVISIONAL)
+    {
+        display_provisional_frequency(frequency);
+        return;
+    }
+    print_result(frequency, "");
+
+    // Snap the display to the measurement, the tracker extrapolates from it until the next one
+    update_pitch_tracker(&pitch_tracker, frequency, time_us_32());
+    display_frequency(frequency);
+}
+
 /**
  * @brief Core 1 Interrupt Handler Function
  *
  * This function serves as the interrupt handler for Core 1.
- * It is responsible for processing incoming frequency valueta from Core 0, updating the display, and controlling LEDs.
+ * It is responsible for receiving the frequency values from Core 0, and passing them to handle_result.
  */
 void core1_interrupt_handler()
 {
     while (multicore_fifo_rvalid())
     {
+        uint32_t result_flags = multicore_fifo_pop_blocking();
         union frequency_union frequency_union;
         frequency_union.i = multicore_fifo_pop_blocking();
-        float frequency = frequency_union.f;
+        handle_result(result_flags, frequency_union.f);
+    }
+    multicore_fifo_clear_irq();
+}
 
-        //Print receiver freq to console
-        printf("\nCore_1: %fHz\n", frequency);
+/**
+ * @brief Refresh Display Function
+ *
+ * This function presents the frequency extrapolated by the pitch tracker, and records how late the refresh is.
+ */
+void refresh_display()
+{
+    uint32_t time = time_us_32();
+    int32_t lateness = time - next_refresh_time;
+    stats_record_refresh_lateness(lateness > 0 ? lateness : 0);
+    next_refresh_time += DISPLAY_REFRESH_US;
 
-        // Normalize received frequency to fit described range.
-        // Division/Multiplication by 2 changes the octave, so for example C4 note will be changed to C3
-        while (frequency < A3_bottom_range)
-            frequency *= 2;
-        while (frequency > A4_bottom_range)
-            frequency /= 2;
+    // The tracker is updated by the interrupt handler
+    uint32_t interrupts = save_and_disable_interrupts();
+    float frequency = predict_pitch(&pitch_tracker, time);
+    if (frequency > 0)
+        display_frequency(frequency);
+    restore_interrupts(interrupts);
+}
 
-        // Fit the frequewncy to the proper range and update output
-        if (frequency > A3_bottom_range && frequency < A3_sharp_bottom_range)
-        {
-            update_display(A_note);
-            update_leds(frequency, A3_freq);
-        }
-        else if (frequency > A3_sharp_bottom_range && frequency < B3_bottom_range)
-        {
-            update_display(A_sharp_note);
-            update_leds(frequency, A3_sharp_freq);
-        }
-        else if (frequency > B3_bottom_range && frequency < C3_bottom_range)
-        {
-            update_display(B_note);
-            update_leds(frequency, B3_freq);
-        }
-        else if (frequency > C3_bottom_range && frequency < C3_sharp_bottom_range)
-        {
-            update_display(C_note);
-            update_leds(frequency, C3_freq);
-        }
-        else if (frequency > C3_sharp_bottom_range && frequency < D3_bottom_range)
-        {
-            update_display(C_sharp_note);
-            update_leds(frequency, C3_sharp_freq);
-        }
-        else if (frequency > D3_bottom_range && frequency < D3_sharp_bottom_range)
-        {
-            update_display(D_note);
-            update_leds(frequency, D3_freq);
-        }
-        else if (frequency > D3_sharp_bottom_range && frequency < E3_bottom_range)
-        {
-            update_display(D_sharp_note);
-            update_leds(frequency, D3_sharp_freq);
-        }
-        else if (frequency > E3_bottom_range && frequency < F3_bottom_range)
-        {
-            update_display(E_note);
-            update_leds(frequency, E3_freq);
-        }
-        else if (frequency > F3_bottom_range && frequency < F3_sharp_bottom_range)
-        {
-            update_display(F_note);
-            update_leds(frequency, F3_freq);
-        }
-        else if (frequency > F3_sharp_bottom_range && frequency < G3_bottom_range)
-        {
-            update_display(F_sharp_note);
-            update_leds(frequency, F3_sharp_freq);
-        }
-        else if (frequency > G3_bottom_range && frequency < G3_sharp_bottom_range)
-        {
-            update_display(G_note);
-            update_leds(frequency, G3_freq);
-        }
-        else if (frequency > G3_sharp_bottom_range && frequency < A4_bottom_range)
-        {
-            update_display(G_sharp_note);
-            update_leds(frequency, G3_sharp_freq);
-        }
-    }
-    multicore_fifo_clear_irq();
+/**
+ * @brief Park Core 1 Function
+ *
+ * This function runs from RAM with interrupts disabled, until core 0 has finished programming the flash.
+ */
+void __not_in_flash_func(park_core1)()
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    core1_parked = true;
+    while (core1_park_request)
+        ;
+    core1_parked = false;
+    restore_interrupts(interrupts);
+}
+
+/**
+ * @brief Service Tasks Function
+ *
+ * With SINGLE_CORE, this function is called by core 0 while it waits for the samples, and between the slices of
+ * the analysis (analysis_yield), and refreshes the display when due. The results are handled right when they are
+ * published, and the USB console is serviced by its own interrupt. The longest interval between the calls bounds
+ * the display latency, it is recorded in the stats. Without SINGLE_CORE, core 1 refreshes the display.
+ * With SHADOW_MODE, core 1 calls it between the slices of the shadow analysis, to respond to a park request.
+ */
+void service_tasks()
+{
+#if SHADOW_MODE
+    if (core1_park_request && get_core_num() == 1)
+        park_core1();
+#endif
+#if SINGLE_CORE
+    static uint32_t last_call_time;
+    uint32_t time = time_us_32();
+    if (last_call_time != 0 && time - last_call_time > stats.max_service_interval)
+        stats.max_service_interval = time - last_call_time;
+    last_call_time = time;
+
+    if (PREDICTIVE_DISPLAY && (int32_t)(time - next_refresh_time) >= 0)
+        refresh_display();
+#endif
+}
+
+/**
+ * @brief Display Refresh Timer Callback
+ *
+ * Called from the alarm interrupt of core 1 every DISPLAY_REFRESH_US, preempting the shadow analysis.
+ *
+ * @return true to keep the timer repeating.
+ */
+bool display_refresh_callback(repeating_timer_t *timer)
+{
+    refresh_display();
+    return true;
 }
 
 /**
@@ -258,14 +880,40 @@ void core1_interrupt_handler()
  *
  * This function serves as the entry point for Core 1.
  * It enables SIO interrupt for core 1, and assigns the exclusive interrupt handler, thatwhich is run when data is received from the FIFO.
+ * With PREDICTIVE_DISPLAY, between the measurements the display is refreshed every DISPLAY_REFRESH_US
+ * with the frequency extrapolated by the pitch tracker.
+ * On request of core 0, core 1 is parked in RAM while the flash is being programmed.
+ * With SHADOW_MODE, the frames submitted by core 0 are analyzed with the shadow engine in the remaining time.
+ * The display refresh is realtime work and the shadow analysis is batch work: with DISPLAY_REFRESH_IRQ the refresh
+ * is driven by an alarm interrupt of core 1, preempting the analysis, otherwise it is polled between the analyses.
  */
 void core1_entry()
 {
+    init_perf_counters();
     multicore_fifo_clear_irq();
     irq_set_exclusive_handler(SIO_IRQ_PROC1, core1_interrupt_handler);
     irq_set_enabled(SIO_IRQ_PROC1, true);
+
+    next_refresh_time = time_us_32() + DISPLAY_REFRESH_US;
+#if PREDICTIVE_DISPLAY && DISPLAY_REFRESH_IRQ
+    // The alarm interrupt of a pool is enabled on the core creating it
+    static repeating_timer_t refresh_timer;
+    alarm_pool_t *alarm_pool = alarm_pool_create(display_refresh_alarm, 1);
+    alarm_pool_add_repeating_timer_us(alarm_pool, -DISPLAY_REFRESH_US, display_refresh_callback, NULL, &refresh_timer);
+#endif
+
     while (1)
     {
+        if (core1_park_request)
+            park_core1();
+
+#if !DISPLAY_REFRESH_IRQ
+        if (PREDICTIVE_DISPLAY && (int32_t)(time_us_32() - next_refresh_time) >= 0)
+            refresh_display();
+#endif
+#if SHADOW_MODE
+        shadow_run();
+#endif
         tight_loop_contents();
     }
 }
@@ -307,6 +955,15 @@ void init_leds()
     gpio_set_dir(HI_PITCH_INDICATOR_PIN, GPIO_OUT);
 }
 
+void init_interp()
+{
+    // Lane 0 returns bits 24-31 of the accumulator (the 8-bit average)
+    interp_config cfg = interp_default_config();
+    interp_config_set_shift(&cfg, SMA_RECIPROCAL_SHIFT);
+    interp_config_set_mask(&cfg, 0, 7);
+    interp_set_config(interp0, 0, &cfg);
+}
+
 void init_adc()
 {
     // Init GPIO for analogue use: hi-Z, no pulls, disable digital input buffer.
@@ -327,7 +984,7 @@ void init_adc()
         true   // Shift each sample to 8 bits since the 4 LSBs are noise
     );
 
-    adc_set_clkdiv(ADCCLK / FS - 1);
+    adc_set_clkdiv(ADCCLK / ADC_FS - 1);
     adc_run(true); // Enable free-running sampling mode
 }
 
@@ -348,11 +1005,11 @@ void init_dma()
     // Configure the channel
     dma_channel_configure(
         sample_channel,
-        &c2,                     // channel config
-        samples_buff,            // dst
-        &adc_hw->fifo,           // src
-        NUM_SAMPLES + SMA_WIDTH, // transfer count
-        false                    // don't start immediately
+        &c2,                         // channel config
+        samples_buff_ptr,            // dst
+        &adc_hw->fifo,               // src
+        CAPTURE_LENGTH(NUM_SAMPLES), // transfer count
+        false                        // don't start immediately
     );
 
     // CONTROL CHANNEL
@@ -370,19 +1027,45 @@ void init_dma()
         false                                   // Don't start immediately.
     );
 
+    // The end of each capture is latched by core 0, see capture_complete_handler
+    dma_channel_set_irq0_enabled(sample_channel, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, capture_complete_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    // Start the first capture with an empty FIFO and cleared flags
+    adc_fifo_drain();
+    hw_set_bits(&adc_hw->fcs, ADC_FCS_OVER_BITS | ADC_FCS_UNDER_BITS);
+    hw_set_bits(&adc_hw->cs, ADC_CS_ERR_STICKY_BITS);
     dma_start_channel_mask((1u << sample_channel));
 }
 
 int main()
 {
+#if SOAK_MONITOR
+    stats_paint_stack();
+#endif
     stdio_init_all();
 
     init_segment_display();
     init_leds();
+    init_interp();
     init_adc();
     init_dma();
+    init_perf_counters(); // SysTick is per core, stages are measured on core 0
+    calibrate();
+    load_lag_priors();
 
+#if SINGLE_CORE
+    // Core 0 refreshes the display while waiting for the samples and between the analysis slices
+    next_refresh_time = time_us_32() + DISPLAY_REFRESH_US;
+    analysis_yield = service_tasks;
+#elif SHADOW_MODE
+    // Launch core 1, with the stack of the shadow engine, which parks between its analysis slices
+    analysis_yield = service_tasks;
+    multicore_launch_core1_with_stack(core1_entry, core1_stack, sizeof(core1_stack));
+#else
     // Launch core 1
     multicore_launch_core1(core1_entry);
+#endif
     core0_thread();
 }
\ No newline at end of file